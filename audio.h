@@ -1,61 +1,3 @@
 void init_audio(void);
 
-unsigned char number_of_sweep_shift;
-unsigned char sweep_increase_decrease;
-unsigned char sweep_time;
-unsigned char sound_length_data;
-unsigned char wave_pattern_duty;
-unsigned char number_of_envelope_sweep;
-unsigned char envelope_direction;
-unsigned char initial_volume_of_envelope;
-unsigned char audio_enabled;
-unsigned char channel1_number_of_sweep_shift;
-unsigned char channel1_sweep_increase_decrease;
-unsigned char channel1_sweep_time;
-unsigned char channel1_sound_length_data;
-unsigned char channel1_wave_pattern_duty;
-unsigned char channel1_number_of_envelope_sweep;
-unsigned char channel1_envelope_direction;
-unsigned char channel1_initial_volume_of_envelope;
-unsigned short channel1_frequency;
-unsigned char channel1_counter_consecutive_selection;
-unsigned char channel1_initial;
-unsigned char channel2_sound_length_data;
-unsigned char channel2_wave_pattern_duty;
-unsigned char channel2_number_of_envelope_sweep;
-unsigned char channel2_envelope_direction;
-unsigned char channel2_initial_volume_of_envelope;
-unsigned short channel2_frequency;
-unsigned char channel2_counter_consecutive_selection;
-unsigned char channel2_initial;
-unsigned char channel3_sound_enabled;
-unsigned char channel3_sound_length;
-unsigned char channel3_select_output_level;
-unsigned short channel3_frequency;
-unsigned char channel3_counter_consecutive_selection;
-unsigned char channel3_initial;
-unsigned char channel4_sound_length;
-unsigned char channel4_number_of_envelope_sweep;
-unsigned char channel4_envelope_direction;
-unsigned char channel4_initial_volume_of_envelope;
-unsigned char channel4_dividing_ratio_of_frequencies;
-unsigned char channel4_counter_step_width;
-unsigned char channel4_shift_clock_frequency;
-unsigned char channel4_counter_consecutive_selection;
-unsigned char channel4_initial;
-unsigned char SO1_output_level;
-unsigned char output_vin_to_SO1_terminal;
-unsigned char SO2_output_level;
-unsigned char output_vin_to_SO2_terminal;
-unsigned char output_sound_1_to_SO1_terminal;
-unsigned char output_sound_2_to_SO1_terminal;
-unsigned char output_sound_3_to_SO1_terminal;
-unsigned char output_sound_4_to_SO1_terminal;
-unsigned char output_sound_1_to_SO2_terminal;
-unsigned char output_sound_2_to_SO2_terminal;
-unsigned char output_sound_3_to_SO2_terminal;
-unsigned char output_sound_4_to_SO2_terminal;
-unsigned char sound_1_ON_flag;
-unsigned char sound_2_ON_flag;
-unsigned char sound_3_ON_flag;
-unsigned char sound_4_ON_flag;
+/* The sound registers NR10-NR52 and wave RAM are raw bytes in the I/O page */
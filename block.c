@@ -0,0 +1,240 @@
+#include "common.h"
+#include "cpu.h"
+#include "mem.h"
+#include "trace.h"
+#include "block.h"
+#include "watch.h"
+
+char block_enabled;
+unsigned long idle_cycles;
+
+struct block *block_pool;
+unsigned int block_nblocks;
+struct block *block_hash[BLOCK_HASH_SIZE];
+
+/* Decoded blocks by start page */
+struct block *block_pages[0x100];
+
+unsigned int block_key ( unsigned short addr )
+{
+    return (code_bank(addr) << 16) | addr;
+}
+
+void block_flush ( void )
+{
+    block_nblocks = 0;
+    memset(block_hash, 0, sizeof(block_hash));
+    memset(block_pages, 0, sizeof(block_pages));
+    unmark_code_pages(CODE_BLOCK);
+}
+
+/* Where a jump op goes when taken, or -1 for other ops */
+int block_jump_target ( struct uop *uop )
+{
+    switch ( uop->op )
+    {
+        case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+            return (unsigned short)(uop->next + (char)uop->imm);
+
+        case 0xc3: case 0xc2: case 0xca: case 0xd2: case 0xda:
+            return uop->imm;
+    }
+
+    return -1;
+}
+
+/* Decode the block at addr.  A block with no instructions marks code that is
+ * always left to exec_instruction(). */
+struct block *block_decode ( unsigned short addr )
+{
+    struct block *block;
+    const struct op_info *info;
+    struct uop *uop;
+    unsigned short at = addr;
+    int region = code_region(addr);
+    unsigned int page;
+
+    if ( block_nblocks == BLOCK_POOL_SIZE )
+        block_flush();
+
+    block = &block_pool[block_nblocks++];
+    block->key = block_key(addr);
+    block->start = addr;
+    block->count = 0;
+    block->cycles = 0;
+    block->loop = 0;
+
+    while ( region >= 0 && block->count < BLOCK_MAX_OPS && !break_pages[at >> 8] )
+    {
+        /* Never fetch operands from past the end of the region */
+        info = &op_info[(unsigned char)peek_mem8(at)];
+        if ( code_region(at + info->length - 1) != region )
+            break;
+
+        uop = &block->uops[block->count];
+        uop->op = decode_op(at, &uop->imm);
+        info = &op_info[uop->op];
+        if ( (info->kind & OP_INVALID) || ((info->kind & OP_SOLO) && block->count) )
+            break;
+
+        at += info->length;
+        uop->next = at;
+        block->count++;
+        block->cycles += info->cycles;
+
+        if ( info->kind & (OP_SOLO | OP_BRANCH) )
+        {
+            /* A side-effect free block that jumps back to itself is a
+             * candidate idle loop */
+            block->loop = !(info->kind & OP_SOLO) && block_jump_target(uop) == addr;
+            break;
+        }
+    }
+
+    block->end = at;
+
+    /* Writes to memory holding decoded code go through block_invalidate() */
+    if ( block->count )
+    {
+        for ( page = addr >> 8; page <= (unsigned short)(at - 1) >> 8; page++ )
+            mark_code_page(page, CODE_BLOCK);
+        block->page_next = block_pages[addr >> 8];
+        block_pages[addr >> 8] = block;
+    }
+
+    block->next = block_hash[block->key & (BLOCK_HASH_SIZE - 1)];
+    block_hash[block->key & (BLOCK_HASH_SIZE - 1)] = block;
+
+    return block;
+}
+
+struct block *block_lookup ( unsigned short addr )
+{
+    unsigned int key = block_key(addr);
+    struct block *block;
+
+    for ( block = block_hash[key & (BLOCK_HASH_SIZE - 1)]; block; block = block->next )
+        if ( block->key == key )
+            return block;
+
+    return block_decode(addr);
+}
+
+void block_save ( struct block_state *s )
+{
+    s->a = a; s->b = b; s->c = c; s->d = d; s->e = e; s->h = h; s->l = l;
+    s->flags = flags;
+    s->flags_lazy = flags_lazy;
+    s->lazy_src = lazy_src;
+    s->lazy_arg = lazy_arg;
+    s->lazy_carry = lazy_carry;
+    s->lazy_res = lazy_res;
+    s->sp = sp;
+}
+
+/* Fast-forward an idle loop taking cycles per iteration through as many
+ * iterations as fit in left, stopping short of the next change to a register
+ * the loop read.  Returns the cycles skipped. */
+unsigned int idle_skip ( unsigned int left, unsigned int cycles )
+{
+    unsigned int skip = left;
+    int until;
+
+    if ( timed_read )
+    {
+        until = timed_until - total_cpu_cycles;
+        if ( until < (int)skip )
+            skip = until > 0 ? until : 0;
+    }
+
+    skip = skip / cycles * cycles;
+    total_cpu_cycles += skip;
+    idle_cycles += skip;
+    return skip;
+}
+
+/*
+ * Run the decoded block at pc.  The whole block runs only if it completes
+ * within budget cycles, the time left until the next hardware event;
+ * otherwise just its first instruction does, as in the interpreter.
+ * Returns 0 when pc has to be decoded by exec_instruction() instead.
+ *
+ * A loop block that writes nothing and comes back to its start with every
+ * register unchanged is polling memory or I/O that cannot change before the
+ * next event, so the iterations up to it are skipped outright.  Registers
+ * computed from the cycle counter can change sooner; the skip stops short of
+ * the first such change.
+ */
+int block_exec ( unsigned int budget )
+{
+    struct block *block;
+    struct block_state before, after;
+    struct uop *uop, *end;
+    unsigned int cycles = 0;
+    int whole;
+
+    if ( !block_enabled )
+        return 0;
+
+    block = block_lookup(pc);
+    if ( block->count == 0 )
+        return 0;
+
+    whole = block->cycles <= budget;
+    if ( whole && block->loop )
+    {
+        block_save(&before);
+        timed_read = 0;
+    }
+
+    end = &block->uops[whole ? block->count : 1];
+    for ( uop = block->uops; uop < end; uop++ )
+    {
+        TRACE();
+        pc = uop->next;
+        exec_op(uop->op, uop->imm);
+        cycles += cpu_cycles;
+    }
+
+    if ( whole && block->loop && pc == block->start )
+    {
+        block_save(&after);
+        if ( memcmp(&before, &after, sizeof(before)) == 0 )
+            cycles += idle_skip(budget - cycles, cycles);
+    }
+
+    cpu_cycles = cycles;
+    return 1;
+}
+
+/* Called on writes to a page holding decoded code */
+void block_invalidate ( unsigned short addr )
+{
+    struct block *block;
+    int page;
+
+    /* Blocks are short, so only ones starting on this or the previous page
+     * can cover addr */
+    for ( page = (addr >> 8) - 1; page <= addr >> 8; page++ )
+    {
+        if ( page < 0 )
+            continue;
+
+        for ( block = block_pages[page]; block; block = block->page_next )
+            if ( block->key != BLOCK_DEAD && addr >= block->start && addr < block->end )
+                block->key = BLOCK_DEAD;
+    }
+}
+
+void init_block ( void )
+{
+    block_pool = calloc(BLOCK_POOL_SIZE, sizeof(struct block));
+    if ( block_pool == NULL )
+    {
+        perror("init_block");
+        exit(EXIT_FAILURE);
+    }
+
+    block_flush();
+    block_enabled = 1;
+}
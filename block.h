@@ -0,0 +1,49 @@
+void init_block(void);
+int block_exec(unsigned int budget);
+void block_invalidate(unsigned short addr);
+void block_flush(void);
+unsigned int idle_skip(unsigned int left, unsigned int cycles);
+
+/*
+ * Decoded block cache.  Straight-line runs of guest code are decoded once
+ * into micro-ops holding each instruction's dispatch index and immediate,
+ * keyed by (bank, pc) like the JIT, so the steady-state loop does no opcode
+ * fetch or decode.  Instructions that write memory or change ime/halt are
+ * kept in blocks of their own.
+ */
+
+#define BLOCK_HASH_SIZE 0x1000 /* Must be a power of two */
+#define BLOCK_MAX_OPS   32     /* Guest instructions per block */
+#define BLOCK_POOL_SIZE 0x4000 /* Blocks decoded before a flush */
+
+struct uop
+{
+    unsigned short op, imm, next;
+};
+
+struct block
+{
+    unsigned int key;
+    unsigned short start, end;
+    unsigned int count, cycles;
+    char loop;
+    struct uop uops[BLOCK_MAX_OPS];
+    struct block *next, *page_next;
+};
+
+#define BLOCK_DEAD 0xffffffff /* Key of a block whose code was overwritten */
+
+/* Guest registers, to spot a loop iteration that changed nothing */
+struct block_state
+{
+    unsigned char a, b, c, d, e, h, l, flags;
+    unsigned char flags_lazy, lazy_src, lazy_arg, lazy_carry;
+    unsigned short lazy_res, sp;
+};
+
+void block_save(struct block_state *s);
+
+char block_enabled;
+
+/* Cycles skipped by fast-forwarding idle polling loops */
+unsigned long idle_cycles;
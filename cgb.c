@@ -0,0 +1,126 @@
+#include "common.h"
+#include "io_regs.h"
+#include "mem.h"
+#include "mbc.h"
+#include "cgb.h"
+
+char cgb_mode;
+char hdma_active;
+unsigned short hdma_src;
+unsigned short hdma_dst;
+
+void set_vram_bank ( unsigned char bank )
+{
+    unsigned int page;
+
+    IO_REG(VBK) = 0xfe | bank;
+    if ( bank == vram_bank )
+        return;
+
+    vram_bank = bank;
+    for ( page = CHARACTER_RAM >> 8; page < (EXTERNAL_RAM >> 8); page++ )
+        map_page(page);
+}
+
+void set_wram_bank ( unsigned char bank )
+{
+    unsigned int page;
+
+    /* Bank 0 selects bank 1 */
+    IO_REG(SVBK) = 0xf8 | bank;
+    if ( bank == 0 )
+        bank = 1;
+    if ( bank == wram_bank )
+        return;
+
+    /* The banked window and its echo */
+    wram_bank = bank;
+    for ( page = WRAM_BANK_N >> 8; page < (OBJECT_ATTRIBUTE >> 8); page++ )
+        if ( (page << 8) & WRAM_BANK_SIZE )
+            map_page(page);
+}
+
+/* Copy the next block into video RAM */
+void hdma_copy ( void )
+{
+    char *from = read_page[hdma_src >> 8];
+    char *to = vram + vram_bank * VRAM_BANK_SIZE + hdma_dst;
+    unsigned short dst = CHARACTER_RAM + hdma_dst;
+    int i;
+
+    if ( from )
+        memcpy(to, from + (hdma_src & 0xff), HDMA_BLOCK);
+    else
+        for ( i = 0; i < HDMA_BLOCK; i++ )
+            to[i] = get_mem8(hdma_src + i);
+
+    if ( code_pages[dst >> 8] )
+        for ( i = 0; i < HDMA_BLOCK; i++ )
+            invalidate_code(dst + i);
+
+    hdma_src += HDMA_BLOCK;
+    hdma_dst = (hdma_dst + HDMA_BLOCK) & (VRAM_BANK_SIZE - 1);
+}
+
+/* HDMA5 write: the low bits are the length in blocks, less one */
+void start_hdma ( unsigned char value )
+{
+    unsigned int blocks = (value & 0x7f) + 1;
+
+    /* Clearing the HBlank bit mid-transfer stops it */
+    if ( hdma_active && !(value & HDMA_HBLANK) )
+    {
+        hdma_active = 0;
+        IO_REG(HDMA5) |= HDMA_HBLANK;
+        return;
+    }
+
+    if ( value & HDMA_HBLANK )
+    {
+        hdma_active = 1;
+        IO_REG(HDMA5) = value & 0x7f;
+        return;
+    }
+
+    while ( blocks-- )
+        hdma_copy();
+    IO_REG(HDMA5) = 0xff;
+}
+
+/* Called as the LCD enters HBlank */
+void hdma_hblank ( void )
+{
+    hdma_copy();
+
+    /* HDMA5 counts down the blocks left, and reads 0xff once done */
+    if ( IO_REG(HDMA5) == 0 )
+    {
+        hdma_active = 0;
+        IO_REG(HDMA5) = 0xff;
+    }
+    else
+    {
+        IO_REG(HDMA5)--;
+    }
+}
+
+void init_cgb ( void )
+{
+    cgb_mode = (rom_data[CART_CGB_FLAG] & 0x80) != 0;
+    hdma_active = 0;
+    hdma_src = 0;
+    hdma_dst = 0;
+
+    IO_REG(HDMA1) = IO_REG(HDMA2) = IO_REG(HDMA3) = IO_REG(HDMA4) = 0xff;
+    IO_REG(HDMA5) = 0xff;
+
+    if ( cgb_mode )
+    {
+        set_vram_bank(0);
+        set_wram_bank(1);
+    }
+    else
+    {
+        IO_REG(VBK) = IO_REG(SVBK) = 0xff;
+    }
+}
@@ -0,0 +1,23 @@
+void init_cgb(void);
+void set_vram_bank(unsigned char bank);
+void set_wram_bank(unsigned char bank);
+void start_hdma(unsigned char value);
+void hdma_hblank(void);
+
+/*
+ * Color GameBoy banking and HDMA.  Switching the video or work RAM bank
+ * repoints the pages of that window; nothing is copied.  HDMA moves one
+ * 16-byte block into video RAM each time the LCD enters HBlank, or the
+ * whole transfer at once for a general-purpose DMA.
+ */
+
+#define CART_CGB_FLAG 0x143 /* Bit 7 set for Color GameBoy titles */
+
+#define HDMA_BLOCK 0x10
+#define HDMA_HBLANK 0x80    /* HDMA5 bit selecting an HBlank transfer */
+
+char cgb_mode;
+
+char hdma_active;           /* HBlank transfer in progress */
+unsigned short hdma_src;
+unsigned short hdma_dst;    /* Offset into video RAM */
@@ -0,0 +1,112 @@
+#include "common.h"
+#include "tables.h"
+
+/*
+ * checktables: compare every entry of the generated tables against the flag
+ * logic the CPU core used before them, so an edit to mktables can't quietly
+ * change what the ALU computes.  The references are deliberately written
+ * differently from mktables: carries come from bit 8 of a wide result and
+ * half carries from the xor of the operands and result, as the lazy flag
+ * macros did, and DAA applies a single correction value.
+ */
+
+#define Z 0x80
+#define N 0x40
+#define H 0x20
+#define C 0x10
+
+unsigned int errors;
+
+void check ( char *table, unsigned int index, unsigned int got, unsigned int want )
+{
+    if ( got == want )
+        return;
+
+    if ( errors++ < 16 )
+        fprintf(stderr, "%s[0x%05x] is 0x%04x, expected 0x%04x\n", table, index, got, want);
+}
+
+/* Z, H and C from a 9-bit result, as LAZY_Z(), LAZY_H() and LAZY_C() */
+unsigned char lazy_flags ( int x, int y, unsigned short result )
+{
+    return (!(result & 0xff) ? Z : 0) |
+           (((x ^ y ^ result) & 0x10) ? H : 0) |
+           (((result >> 8) & 1) ? C : 0);
+}
+
+unsigned short daa_reference ( int x, int n, int h, int c )
+{
+    int correction = 0;
+
+    if ( h || (!n && (x & 0xf) > 0x9) )
+        correction |= 0x06;
+    if ( c || (!n && x > 0x99) )
+    {
+        correction |= 0x60;
+        c = 1;
+    }
+
+    x = (n ? x - correction : x + correction) & 0xff;
+    return (x << 8) | (x ? 0 : Z) | (n ? N : 0) | (c ? C : 0);
+}
+
+/* The rotate and shift family as a 9-bit value whose top bit is carry */
+unsigned short shift_reference ( int op, int x, int carry )
+{
+    unsigned int wide;
+
+    switch ( op )
+    {
+        case SHIFT_RLC:  wide = (x << 1) | (x >> 7); break;
+        case SHIFT_RRC:  wide = ((x & 1) << 8) | ((x & 1) << 7) | (x >> 1); break;
+        case SHIFT_RL:   wide = (x << 1) | carry; break;
+        case SHIFT_RR:   wide = ((x & 1) << 8) | (carry << 7) | (x >> 1); break;
+        case SHIFT_SLA:  wide = x << 1; break;
+        case SHIFT_SRA:  wide = ((x & 1) << 8) | (x & 0x80) | (x >> 1); break;
+        case SHIFT_SWAP: wide = ((x << 4) | (x >> 4)) & 0xff; break;
+        default:         wide = ((x & 1) << 8) | (x >> 1); break;
+    }
+
+    return ((wide & 0xff) << 8) | ((wide & 0xff) ? 0 : Z) | ((wide & 0x100) ? C : 0);
+}
+
+int main ( void )
+{
+    unsigned int carry, x, y, f, op;
+
+    for ( carry = 0; carry < 2; carry++ )
+        for ( x = 0; x < 256; x++ )
+            for ( y = 0; y < 256; y++ )
+            {
+                check("alu_add_table", ALU_INDEX(carry, x, y), alu_add_table[ALU_INDEX(carry, x, y)],
+                      lazy_flags(x, y, x + y + carry));
+                check("alu_sub_table", ALU_INDEX(carry, x, y), alu_sub_table[ALU_INDEX(carry, x, y)],
+                      N | lazy_flags(x, y, (unsigned short)(x - y - carry)));
+            }
+
+    for ( x = 0; x < 256; x++ )
+    {
+        check("inc_flags_table", x, inc_flags_table[x], lazy_flags(x, 1, (x + 1) & 0xff));
+        check("dec_flags_table", x, dec_flags_table[x], N | lazy_flags(x, 1, (x - 1) & 0xff));
+    }
+
+    for ( f = 0; f < 0x80; f += 0x10 )
+        for ( x = 0; x < 256; x++ )
+            check("daa_table", DAA_INDEX(f, x), daa_table[DAA_INDEX(f, x)],
+                  daa_reference(x, f & N, f & H, f & C));
+
+    for ( op = 0; op < 8; op++ )
+        for ( carry = 0; carry < 2; carry++ )
+            for ( x = 0; x < 256; x++ )
+                check("shift_table", SHIFT_INDEX(op, carry, x), shift_table[SHIFT_INDEX(op, carry, x)],
+                      shift_reference(op, x, carry));
+
+    if ( errors )
+    {
+        fprintf(stderr, "%u table entries differ\n", errors);
+        return 1;
+    }
+
+    printf("All table entries match\n");
+    return 0;
+}
@@ -4,167 +4,421 @@
 #include "common.h"
 #include "cpu.h"
 #include "mem.h"
+#include "interrupt.h"
+#include "trace.h"
+#include "tables.h"
+
+/*
+ * Opcode dispatch.  Instructions are decoded up front into a flat 512-entry
+ * index (0x000-0x0ff base opcodes, 0x100-0x1ff CB opcodes) plus an immediate
+ * operand.  The default core is a plain switch; building with
+ * THREADED_DISPATCH jumps through a table of label addresses instead.  The
+ * switch statements are kept in the threaded build only to scope break.
+ */
+#ifndef THREADED_DISPATCH
+#define THREADED_DISPATCH 0
+#endif
 
-#define __DEBUG__ 1
-
-#if __DEBUG__
-#define DEBUG(fmt, ...) printf(fmt, ##__VA_ARGS__)
+#if THREADED_DISPATCH
+#define DISPATCH(op)    goto *dispatch_table[op]; switch ( op )
+#define CB_DISPATCH(op) switch ( op )
+#define OP(n)           op_##n
+#define CB_OP(n)        cb_##n
+#define CB_DEFAULT      cb_default
 #else
-#define DEBUG(fmt, ...)
+#define DISPATCH(op)    switch ( (op) & 0x100 ? 0xcb : (op) )
+#define CB_DISPATCH(op) switch ( (op) & 0xff )
+#define OP(n)           case n
+#define CB_OP(n)        case n
+#define CB_DEFAULT      default
 #endif
 
+/* Immediate operand of the instruction being run */
+#define IMM8()  ((char)imm)
+#define IMM16() ((short)imm)
+
 /* CPU run state */
 char halt;
+char cpu_sync;
 unsigned int cpu_cycles;
 unsigned int total_cpu_cycles;
+unsigned int cycles_ahead;
 
 /* General 8-bit data registers */
 unsigned char a, b, c, d, e, h, l, flags;
 
+/* Lazy flag state */
+unsigned char flags_lazy;
+unsigned char lazy_src, lazy_arg, lazy_carry;
+unsigned short lazy_res;
+
 /* Flow control registers */
 unsigned short pc, sp;
 
 /* Interrupt master enable flag */
 char ime;
 
-/* Return a byte at pc */
-char peek_byte ( void )
+/* Length, cycles and kind of every dispatch index; cycles must match what
+ * the handlers below charge, taking the branch for conditional ones */
+const struct op_info op_info[0x200] = {
+    /* 0x000 */ { 1,  4, 0 }, { 3, 12, 0 }, { 1,  8, OP_SOLO }, { 1,  8, 0 },
+    /* 0x004 */ { 1,  4, 0 }, { 1,  4, 0 }, { 2,  8, 0 }, { 1,  4, 0 },
+    /* 0x008 */ { 3, 20, OP_SOLO }, { 1,  8, 0 }, { 1,  8, 0 }, { 1,  8, 0 },
+    /* 0x00c */ { 1,  4, 0 }, { 1,  4, 0 }, { 2,  8, 0 }, { 1,  4, 0 },
+    /* 0x010 */ { 2,  4, OP_SOLO }, { 3, 12, 0 }, { 1,  8, OP_SOLO }, { 1,  8, 0 },
+    /* 0x014 */ { 1,  4, 0 }, { 1,  4, 0 }, { 2,  8, 0 }, { 1,  4, 0 },
+    /* 0x018 */ { 2, 12, OP_BRANCH }, { 1,  8, 0 }, { 1,  8, 0 }, { 1,  8, 0 },
+    /* 0x01c */ { 1,  4, 0 }, { 1,  4, 0 }, { 2,  8, 0 }, { 1,  4, 0 },
+    /* 0x020 */ { 2, 12, OP_BRANCH }, { 3, 12, 0 }, { 1,  8, OP_SOLO }, { 1,  8, 0 },
+    /* 0x024 */ { 1,  4, 0 }, { 1,  4, 0 }, { 2,  8, 0 }, { 1,  4, 0 },
+    /* 0x028 */ { 2, 12, OP_BRANCH }, { 1,  8, 0 }, { 1,  8, 0 }, { 1,  8, 0 },
+    /* 0x02c */ { 1,  4, 0 }, { 1,  4, 0 }, { 2,  8, 0 }, { 1,  4, 0 },
+    /* 0x030 */ { 2, 12, OP_BRANCH }, { 3, 12, 0 }, { 1,  8, OP_SOLO }, { 1,  8, 0 },
+    /* 0x034 */ { 1, 12, OP_SOLO }, { 1, 12, OP_SOLO }, { 2, 12, OP_SOLO }, { 1,  4, 0 },
+    /* 0x038 */ { 2, 12, OP_BRANCH }, { 1,  8, 0 }, { 1,  8, 0 }, { 1,  8, 0 },
+    /* 0x03c */ { 1,  4, 0 }, { 1,  4, 0 }, { 2,  8, 0 }, { 1,  4, 0 },
+    /* 0x040 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 },
+    /* 0x044 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  8, 0 }, { 1,  4, 0 },
+    /* 0x048 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 },
+    /* 0x04c */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  8, 0 }, { 1,  4, 0 },
+    /* 0x050 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 },
+    /* 0x054 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  8, 0 }, { 1,  4, 0 },
+    /* 0x058 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 },
+    /* 0x05c */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  8, 0 }, { 1,  4, 0 },
+    /* 0x060 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 },
+    /* 0x064 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  8, 0 }, { 1,  4, 0 },
+    /* 0x068 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 },
+    /* 0x06c */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  8, 0 }, { 1,  4, 0 },
+    /* 0x070 */ { 1,  8, OP_SOLO }, { 1,  8, OP_SOLO }, { 1,  8, OP_SOLO }, { 1,  8, OP_SOLO },
+    /* 0x074 */ { 1,  8, OP_SOLO }, { 1,  8, OP_SOLO }, { 1,  4, OP_SOLO }, { 1,  8, OP_SOLO },
+    /* 0x078 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 },
+    /* 0x07c */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  8, 0 }, { 1,  4, 0 },
+    /* 0x080 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 },
+    /* 0x084 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  8, 0 }, { 1,  4, 0 },
+    /* 0x088 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 },
+    /* 0x08c */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  8, 0 }, { 1,  4, 0 },
+    /* 0x090 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 },
+    /* 0x094 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  8, 0 }, { 1,  4, 0 },
+    /* 0x098 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 },
+    /* 0x09c */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  8, 0 }, { 1,  4, 0 },
+    /* 0x0a0 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 },
+    /* 0x0a4 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  8, 0 }, { 1,  4, 0 },
+    /* 0x0a8 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 },
+    /* 0x0ac */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  8, 0 }, { 1,  4, 0 },
+    /* 0x0b0 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 },
+    /* 0x0b4 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  8, 0 }, { 1,  4, 0 },
+    /* 0x0b8 */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 }, { 1,  4, 0 },
+    /* 0x0bc */ { 1,  4, 0 }, { 1,  4, 0 }, { 1,  8, 0 }, { 1,  4, 0 },
+    /* 0x0c0 */ { 1, 20, OP_BRANCH }, { 1, 12, 0 }, { 3, 16, OP_BRANCH }, { 3, 16, OP_BRANCH },
+    /* 0x0c4 */ { 3, 24, OP_BRANCH|OP_SOLO }, { 1, 16, OP_SOLO }, { 2,  8, 0 }, { 1, 32, OP_BRANCH|OP_SOLO },
+    /* 0x0c8 */ { 1, 20, OP_BRANCH }, { 1, 16, OP_BRANCH }, { 3, 16, OP_BRANCH }, { 2,  0, 0 },
+    /* 0x0cc */ { 3, 24, OP_BRANCH|OP_SOLO }, { 3, 24, OP_BRANCH|OP_SOLO }, { 2,  8, 0 }, { 1, 32, OP_BRANCH|OP_SOLO },
+    /* 0x0d0 */ { 1, 20, OP_BRANCH }, { 1, 12, 0 }, { 3, 16, OP_BRANCH }, { 1,  0, OP_INVALID },
+    /* 0x0d4 */ { 3, 24, OP_BRANCH|OP_SOLO }, { 1, 16, OP_SOLO }, { 2,  8, 0 }, { 1, 32, OP_BRANCH|OP_SOLO },
+    /* 0x0d8 */ { 1, 20, OP_BRANCH }, { 1, 16, OP_BRANCH|OP_SOLO }, { 3, 16, OP_BRANCH }, { 1,  0, OP_INVALID },
+    /* 0x0dc */ { 3, 24, OP_BRANCH|OP_SOLO }, { 1,  0, OP_INVALID }, { 1,  0, OP_INVALID }, { 1, 32, OP_BRANCH|OP_SOLO },
+    /* 0x0e0 */ { 2, 12, OP_SOLO }, { 1, 12, 0 }, { 1,  8, OP_SOLO }, { 1,  0, OP_INVALID },
+    /* 0x0e4 */ { 1,  0, OP_INVALID }, { 1, 16, OP_SOLO }, { 2,  8, 0 }, { 1, 32, OP_BRANCH|OP_SOLO },
+    /* 0x0e8 */ { 2, 16, 0 }, { 1,  4, OP_BRANCH }, { 3, 16, OP_SOLO }, { 1,  0, OP_INVALID },
+    /* 0x0ec */ { 1,  0, OP_INVALID }, { 1,  0, OP_INVALID }, { 2,  8, 0 }, { 1, 32, OP_BRANCH|OP_SOLO },
+    /* 0x0f0 */ { 2, 12, 0 }, { 1, 12, 0 }, { 1,  8, 0 }, { 1,  4, OP_SOLO },
+    /* 0x0f4 */ { 1,  0, OP_INVALID }, { 1, 16, OP_SOLO }, { 2,  8, 0 }, { 1, 32, OP_BRANCH|OP_SOLO },
+    /* 0x0f8 */ { 2, 12, 0 }, { 1,  8, 0 }, { 3, 16, 0 }, { 1,  4, OP_SOLO },
+    /* 0x0fc */ { 1,  0, OP_INVALID }, { 1,  0, OP_INVALID }, { 2,  8, 0 }, { 1, 32, OP_BRANCH|OP_SOLO },
+    /* 0x100 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x104 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2, 16, OP_SOLO }, { 2,  8, 0 },
+    /* 0x108 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x10c */ { 2,  8, 0 }, { 2,  8, 0 }, { 2, 16, OP_SOLO }, { 2,  8, 0 },
+    /* 0x110 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x114 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2, 16, OP_SOLO }, { 2,  8, 0 },
+    /* 0x118 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x11c */ { 2,  8, 0 }, { 2,  8, 0 }, { 2, 16, OP_SOLO }, { 2,  8, 0 },
+    /* 0x120 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x124 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2, 16, OP_SOLO }, { 2,  8, 0 },
+    /* 0x128 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x12c */ { 2,  8, 0 }, { 2,  8, 0 }, { 2, 16, OP_SOLO }, { 2,  8, 0 },
+    /* 0x130 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x134 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2, 16, OP_SOLO }, { 2,  8, 0 },
+    /* 0x138 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x13c */ { 2,  8, 0 }, { 2,  8, 0 }, { 2, 16, OP_SOLO }, { 2,  8, 0 },
+    /* 0x140 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x144 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x148 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x14c */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x150 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x154 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x158 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x15c */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x160 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x164 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x168 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x16c */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x170 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x174 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x178 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x17c */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x180 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x184 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, OP_SOLO }, { 2,  8, 0 },
+    /* 0x188 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x18c */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, OP_SOLO }, { 2,  8, 0 },
+    /* 0x190 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x194 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, OP_SOLO }, { 2,  8, 0 },
+    /* 0x198 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x19c */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, OP_SOLO }, { 2,  8, 0 },
+    /* 0x1a0 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x1a4 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, OP_SOLO }, { 2,  8, 0 },
+    /* 0x1a8 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x1ac */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, OP_SOLO }, { 2,  8, 0 },
+    /* 0x1b0 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x1b4 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, OP_SOLO }, { 2,  8, 0 },
+    /* 0x1b8 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x1bc */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, OP_SOLO }, { 2,  8, 0 },
+    /* 0x1c0 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x1c4 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, OP_SOLO }, { 2,  8, 0 },
+    /* 0x1c8 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x1cc */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, OP_SOLO }, { 2,  8, 0 },
+    /* 0x1d0 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x1d4 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, OP_SOLO }, { 2,  8, 0 },
+    /* 0x1d8 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x1dc */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, OP_SOLO }, { 2,  8, 0 },
+    /* 0x1e0 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x1e4 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, OP_SOLO }, { 2,  8, 0 },
+    /* 0x1e8 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x1ec */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, OP_SOLO }, { 2,  8, 0 },
+    /* 0x1f0 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x1f4 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, OP_SOLO }, { 2,  8, 0 },
+    /* 0x1f8 */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, 0 },
+    /* 0x1fc */ { 2,  8, 0 }, { 2,  8, 0 }, { 2,  8, OP_SOLO }, { 2,  8, 0 },
+};
+
+/* Return two bytes at addr */
+short peek_word ( unsigned short addr )
 {
-    return get_mem8(pc);
+    if ( (0x10000 - addr) < 0x2 )
+    {
+        printf("Error!  Referencing outside of address space.\n");
+        return 0; // Look up how GameBoy handles this exception
+    }
+
+    return (unsigned char)peek_mem8(addr) | (peek_mem8(addr + 1) << 8);
 }
 
-/* Return a byte at pc and advance pc by 1 */
-char read_byte ( void )
+/* Decode the instruction at addr into its dispatch index (0x100 | n for CB
+ * prefixed ops) and its immediate operand, if it has one */
+unsigned short decode_op ( unsigned short addr, unsigned short *imm )
 {
-    char byte = peek_byte();
-//    printf("Reading byte %hhx\n", byte);
-    pc++;
-    return byte;
+    unsigned short op = (unsigned char)peek_mem8(addr);
+
+    *imm = 0;
+    if ( op == 0xcb )
+        op = 0x100 | (unsigned char)peek_mem8(addr + 1);
+    else if ( op_info[op].length == 2 )
+        *imm = (unsigned char)peek_mem8(addr + 1);
+    else if ( op_info[op].length == 3 )
+        *imm = peek_word(addr + 1);
+
+    return op;
 }
 
-/* Return two bytes at pc */
-short peek_word ( void )
+/* Rebuild flags from the last lazily evaluated ALU op */
+unsigned char sync_flags ( void )
 {
-    if ( (0x10000 - pc) < 0x2 )
+    switch ( flags_lazy )
     {
-        printf("Error!  Referencing outside of address space.\n");
-        return 0; // Look up how GameBoy handles this exception
-    }
+        case LAZY_ADD:
+            flags = alu_add_table[ALU_INDEX(lazy_carry, lazy_src, lazy_arg)];
+            break;
 
-    return get_mem16(pc);
-}
+        case LAZY_SUB:
+            flags = alu_sub_table[ALU_INDEX(lazy_carry, lazy_src, lazy_arg)];
+            break;
 
-/* Return two bytes at pc and advance pc by 2 */
-short read_word ( void )
-{
-    short word = peek_word();
-//    printf("Reading word %hx\n", word);
-    pc += 2;
-    return word;
+        case LAZY_INC:
+            flags = inc_flags_table[lazy_src] | (lazy_carry << C_SHIFT);
+            break;
+
+        case LAZY_DEC:
+            flags = dec_flags_table[lazy_src] | (lazy_carry << C_SHIFT);
+            break;
+    }
+    flags_lazy = LAZY_NONE;
+
+    return flags;
 }
 
 void dump_regs ( void )
 {
-    printf("pc=%04hx sp=%04hx flags=%02hhx\n", pc, sp, flags);
+    printf("pc=%04hx sp=%04hx flags=%02hhx\n", pc, sp, GET_FLAGS());
     printf("a=%02hhx b=%02hhx c=%02hhx d=%02hhx e=%02hhx h=%02hhx l=%02hhx\n\n", a, b, c, d, e, h, l);
 }
 
-void exec_instruction ( void )
+/* Run one decoded instruction; pc must already point past it */
+void exec_op ( unsigned short op, unsigned short imm )
 {
-    unsigned char op;
 
-    DEBUG("%04hx  ", pc);
+#if THREADED_DISPATCH
+    static void *dispatch_table[512] = {
+        [0x000 ... 0x0ff] = &&INVALID_OP,
+        [0x000] = &&op_0x00, [0x001] = &&op_0x01, [0x002] = &&op_0x02, [0x003] = &&op_0x03,
+        [0x004] = &&op_0x04, [0x005] = &&op_0x05, [0x006] = &&op_0x06, [0x007] = &&op_0x07,
+        [0x008] = &&op_0x08, [0x009] = &&op_0x09, [0x00a] = &&op_0x0a, [0x00b] = &&op_0x0b,
+        [0x00c] = &&op_0x0c, [0x00d] = &&op_0x0d, [0x00e] = &&op_0x0e, [0x00f] = &&op_0x0f,
+        [0x010] = &&op_0x10, [0x011] = &&op_0x11, [0x012] = &&op_0x12, [0x013] = &&op_0x13,
+        [0x014] = &&op_0x14, [0x015] = &&op_0x15, [0x016] = &&op_0x16, [0x017] = &&op_0x17,
+        [0x018] = &&op_0x18, [0x019] = &&op_0x19, [0x01a] = &&op_0x1a, [0x01b] = &&op_0x1b,
+        [0x01c] = &&op_0x1c, [0x01d] = &&op_0x1d, [0x01e] = &&op_0x1e, [0x01f] = &&op_0x1f,
+        [0x020] = &&op_0x20, [0x021] = &&op_0x21, [0x022] = &&op_0x22, [0x023] = &&op_0x23,
+        [0x024] = &&op_0x24, [0x025] = &&op_0x25, [0x026] = &&op_0x26, [0x027] = &&op_0x27,
+        [0x028] = &&op_0x28, [0x029] = &&op_0x29, [0x02a] = &&op_0x2a, [0x02b] = &&op_0x2b,
+        [0x02c] = &&op_0x2c, [0x02d] = &&op_0x2d, [0x02e] = &&op_0x2e, [0x02f] = &&op_0x2f,
+        [0x030] = &&op_0x30, [0x031] = &&op_0x31, [0x032] = &&op_0x32, [0x033] = &&op_0x33,
+        [0x034] = &&op_0x34, [0x035] = &&op_0x35, [0x036] = &&op_0x36, [0x037] = &&op_0x37,
+        [0x038] = &&op_0x38, [0x039] = &&op_0x39, [0x03a] = &&op_0x3a, [0x03b] = &&op_0x3b,
+        [0x03c] = &&op_0x3c, [0x03d] = &&op_0x3d, [0x03e] = &&op_0x3e, [0x03f] = &&op_0x3f,
+        [0x040] = &&op_0x40, [0x041] = &&op_0x41, [0x042] = &&op_0x42, [0x043] = &&op_0x43,
+        [0x044] = &&op_0x44, [0x045] = &&op_0x45, [0x046] = &&op_0x46, [0x047] = &&op_0x47,
+        [0x048] = &&op_0x48, [0x049] = &&op_0x49, [0x04a] = &&op_0x4a, [0x04b] = &&op_0x4b,
+        [0x04c] = &&op_0x4c, [0x04d] = &&op_0x4d, [0x04e] = &&op_0x4e, [0x04f] = &&op_0x4f,
+        [0x050] = &&op_0x50, [0x051] = &&op_0x51, [0x052] = &&op_0x52, [0x053] = &&op_0x53,
+        [0x054] = &&op_0x54, [0x055] = &&op_0x55, [0x056] = &&op_0x56, [0x057] = &&op_0x57,
+        [0x058] = &&op_0x58, [0x059] = &&op_0x59, [0x05a] = &&op_0x5a, [0x05b] = &&op_0x5b,
+        [0x05c] = &&op_0x5c, [0x05d] = &&op_0x5d, [0x05e] = &&op_0x5e, [0x05f] = &&op_0x5f,
+        [0x060] = &&op_0x60, [0x061] = &&op_0x61, [0x062] = &&op_0x62, [0x063] = &&op_0x63,
+        [0x064] = &&op_0x64, [0x065] = &&op_0x65, [0x066] = &&op_0x66, [0x067] = &&op_0x67,
+        [0x068] = &&op_0x68, [0x069] = &&op_0x69, [0x06a] = &&op_0x6a, [0x06b] = &&op_0x6b,
+        [0x06c] = &&op_0x6c, [0x06d] = &&op_0x6d, [0x06e] = &&op_0x6e, [0x06f] = &&op_0x6f,
+        [0x070] = &&op_0x70, [0x071] = &&op_0x71, [0x072] = &&op_0x72, [0x073] = &&op_0x73,
+        [0x074] = &&op_0x74, [0x075] = &&op_0x75, [0x076] = &&op_0x76, [0x077] = &&op_0x77,
+        [0x078] = &&op_0x78, [0x079] = &&op_0x79, [0x07a] = &&op_0x7a, [0x07b] = &&op_0x7b,
+        [0x07c] = &&op_0x7c, [0x07d] = &&op_0x7d, [0x07e] = &&op_0x7e, [0x07f] = &&op_0x7f,
+        [0x080] = &&op_0x80, [0x081] = &&op_0x81, [0x082] = &&op_0x82, [0x083] = &&op_0x83,
+        [0x084] = &&op_0x84, [0x085] = &&op_0x85, [0x086] = &&op_0x86, [0x087] = &&op_0x87,
+        [0x088] = &&op_0x88, [0x089] = &&op_0x89, [0x08a] = &&op_0x8a, [0x08b] = &&op_0x8b,
+        [0x08c] = &&op_0x8c, [0x08d] = &&op_0x8d, [0x08e] = &&op_0x8e, [0x08f] = &&op_0x8f,
+        [0x090] = &&op_0x90, [0x091] = &&op_0x91, [0x092] = &&op_0x92, [0x093] = &&op_0x93,
+        [0x094] = &&op_0x94, [0x095] = &&op_0x95, [0x096] = &&op_0x96, [0x097] = &&op_0x97,
+        [0x098] = &&op_0x98, [0x099] = &&op_0x99, [0x09a] = &&op_0x9a, [0x09b] = &&op_0x9b,
+        [0x09c] = &&op_0x9c, [0x09d] = &&op_0x9d, [0x09e] = &&op_0x9e, [0x09f] = &&op_0x9f,
+        [0x0a0] = &&op_0xa0, [0x0a1] = &&op_0xa1, [0x0a2] = &&op_0xa2, [0x0a3] = &&op_0xa3,
+        [0x0a4] = &&op_0xa4, [0x0a5] = &&op_0xa5, [0x0a6] = &&op_0xa6, [0x0a7] = &&op_0xa7,
+        [0x0a8] = &&op_0xa8, [0x0a9] = &&op_0xa9, [0x0aa] = &&op_0xaa, [0x0ab] = &&op_0xab,
+        [0x0ac] = &&op_0xac, [0x0ad] = &&op_0xad, [0x0ae] = &&op_0xae, [0x0af] = &&op_0xaf,
+        [0x0b0] = &&op_0xb0, [0x0b1] = &&op_0xb1, [0x0b2] = &&op_0xb2, [0x0b3] = &&op_0xb3,
+        [0x0b4] = &&op_0xb4, [0x0b5] = &&op_0xb5, [0x0b6] = &&op_0xb6, [0x0b7] = &&op_0xb7,
+        [0x0b8] = &&op_0xb8, [0x0b9] = &&op_0xb9, [0x0ba] = &&op_0xba, [0x0bb] = &&op_0xbb,
+        [0x0bc] = &&op_0xbc, [0x0bd] = &&op_0xbd, [0x0be] = &&op_0xbe, [0x0bf] = &&op_0xbf,
+        [0x0c0] = &&op_0xc0, [0x0c1] = &&op_0xc1, [0x0c2] = &&op_0xc2, [0x0c3] = &&op_0xc3,
+        [0x0c4] = &&op_0xc4, [0x0c5] = &&op_0xc5, [0x0c6] = &&op_0xc6, [0x0c7] = &&op_0xc7,
+        [0x0c8] = &&op_0xc8, [0x0c9] = &&op_0xc9, [0x0ca] = &&op_0xca, [0x0cb] = &&op_0xcb,
+        [0x0cc] = &&op_0xcc, [0x0cd] = &&op_0xcd, [0x0ce] = &&op_0xce, [0x0cf] = &&op_0xcf,
+        [0x0d0] = &&op_0xd0, [0x0d1] = &&op_0xd1, [0x0d2] = &&op_0xd2, [0x0d4] = &&op_0xd4,
+        [0x0d5] = &&op_0xd5, [0x0d6] = &&op_0xd6, [0x0d7] = &&op_0xd7, [0x0d8] = &&op_0xd8,
+        [0x0d9] = &&op_0xd9, [0x0da] = &&op_0xda, [0x0dc] = &&op_0xdc, [0x0df] = &&op_0xdf,
+        [0x0e0] = &&op_0xe0, [0x0e1] = &&op_0xe1, [0x0e2] = &&op_0xe2, [0x0e5] = &&op_0xe5,
+        [0x0e6] = &&op_0xe6, [0x0e7] = &&op_0xe7, [0x0e8] = &&op_0xe8, [0x0e9] = &&op_0xe9,
+        [0x0ea] = &&op_0xea, [0x0ee] = &&op_0xee, [0x0ef] = &&op_0xef, [0x0f0] = &&op_0xf0,
+        [0x0f1] = &&op_0xf1, [0x0f2] = &&op_0xf2, [0x0f3] = &&op_0xf3, [0x0f5] = &&op_0xf5,
+        [0x0f6] = &&op_0xf6, [0x0f7] = &&op_0xf7, [0x0f8] = &&op_0xf8, [0x0f9] = &&op_0xf9,
+        [0x0fa] = &&op_0xfa, [0x0fb] = &&op_0xfb, [0x0fe] = &&op_0xfe, [0x0ff] = &&op_0xff,
+        [0x100] = &&cb_0x00, [0x101] = &&cb_0x01, [0x102] = &&cb_0x02, [0x103] = &&cb_0x03,
+        [0x104] = &&cb_0x04, [0x105] = &&cb_0x05, [0x106] = &&cb_0x06, [0x107] = &&cb_0x07,
+        [0x108] = &&cb_0x08, [0x109] = &&cb_0x09, [0x10a] = &&cb_0x0a, [0x10b] = &&cb_0x0b,
+        [0x10c] = &&cb_0x0c, [0x10d] = &&cb_0x0d, [0x10e] = &&cb_0x0e, [0x10f] = &&cb_0x0f,
+        [0x110] = &&cb_0x10, [0x111] = &&cb_0x11, [0x112] = &&cb_0x12, [0x113] = &&cb_0x13,
+        [0x114] = &&cb_0x14, [0x115] = &&cb_0x15, [0x116] = &&cb_0x16, [0x117] = &&cb_0x17,
+        [0x118] = &&cb_0x18, [0x119] = &&cb_0x19, [0x11a] = &&cb_0x1a, [0x11b] = &&cb_0x1b,
+        [0x11c] = &&cb_0x1c, [0x11d] = &&cb_0x1d, [0x11e] = &&cb_0x1e, [0x11f] = &&cb_0x1f,
+        [0x120] = &&cb_0x20, [0x121] = &&cb_0x21, [0x122] = &&cb_0x22, [0x123] = &&cb_0x23,
+        [0x124] = &&cb_0x24, [0x125] = &&cb_0x25, [0x126] = &&cb_0x26, [0x127] = &&cb_0x27,
+        [0x128] = &&cb_0x28, [0x129] = &&cb_0x29, [0x12a] = &&cb_0x2a, [0x12b] = &&cb_0x2b,
+        [0x12c] = &&cb_0x2c, [0x12d] = &&cb_0x2d, [0x12e] = &&cb_0x2e, [0x12f] = &&cb_0x2f,
+        [0x130] = &&cb_0x30, [0x131] = &&cb_0x31, [0x132] = &&cb_0x32, [0x133] = &&cb_0x33,
+        [0x134] = &&cb_0x34, [0x135] = &&cb_0x35, [0x136] = &&cb_0x36, [0x137] = &&cb_0x37,
+        [0x138] = &&cb_0x38, [0x139] = &&cb_0x39, [0x13a] = &&cb_0x3a, [0x13b] = &&cb_0x3b,
+        [0x13c] = &&cb_0x3c, [0x13d] = &&cb_0x3d, [0x13e] = &&cb_0x3e, [0x13f] = &&cb_0x3f,
+        [0x140 ... 0x1ff] = &&cb_default
+    };
+#endif
 
-    op = read_byte();
+    if ( op_info[op].kind & OP_SOLO )
+        cpu_sync = 1;
 
-    switch ( op )
+    DISPATCH(op)
     {
         /* NOP */
-        case 0x00:
-            DEBUG("nop\n");
+        OP(0x00):
             cpu_cycles = 4;
             break;
 
         /* LD BC, nn */
-        case 0x01:
+        OP(0x01):
         {
-            unsigned short tmp = read_word();
-            DEBUG("ld bc, 0x%hx\n", tmp);
+            unsigned short tmp = IMM16();
             SET_BC(tmp);
             cpu_cycles = 12;
             break;
         }
 
         /* LD (BC), A */
-        case 0x02:
-            DEBUG("ld (bc), a\n");
+        OP(0x02):
             set_mem8(GET_BC(), a);
             cpu_cycles = 8;
             break;
 
         /* INC BC */
-        case 0x03:
-            DEBUG("inc bc\n");
+        OP(0x03):
             INC16(BC);
             cpu_cycles = 8;
             break;
 
         /* INC B */
-        case 0x04:
-            DEBUG("inc b\n");
+        OP(0x04):
             INC(b);
             cpu_cycles = 4;
             break;
 
         /* DEC B */
-        case 0x05:
-            DEBUG("dec b\n");
+        OP(0x05):
             DEC(b);
             cpu_cycles = 4;
             break;
 
         /* LD B, n */
-        case 0x06:
+        OP(0x06):
         {
-            b = read_byte();
-            DEBUG("ld b, 0x%hhx\n", b);
+            b = IMM8();
             cpu_cycles = 8;
             break;
         }
 
         /* RLCA */
-        case 0x07:
-            DEBUG("rlca\n");
+        OP(0x07):
             RLC(a);
+            flags &= C_FLAG;
             cpu_cycles = 4;
             break;
 
         /* LD (nn), SP */
-        case 0x08:
+        OP(0x08):
         {
-            unsigned short tmp = read_word();
-            DEBUG("ld (0x%hx), sp)\n", tmp);
+            unsigned short tmp = IMM16();
             set_mem16(tmp, sp);
             cpu_cycles = 20;
             break;
         }
 
         /* ADD HL, BC */
-        case 0x09:
-            DEBUG("add hl, bc\n");
+        OP(0x09):
             ADD16(HL, BC);
             cpu_cycles = 8;
             break;
 
         /* 10 prefix */
-        case 0x10:
-            op = read_byte();
-
-            switch ( op )
+        OP(0x10):
+            switch ( IMM8() )
             {
                 /* STOP */
                 case 0x00:
-                    DEBUG("stop\n");
                     /* XXX */
                     cpu_cycles = 4;
                     break;
@@ -176,293 +430,259 @@ void exec_instruction ( void )
             break;
 
         /* LD A, (BC) */
-        case 0x0a:
-            DEBUG("ld a, (bc)\n");
+        OP(0x0a):
             a = get_mem8(GET_BC());
             cpu_cycles = 8;
             break;
 
         /* DEC BC */
-        case 0x0b:
-            DEBUG("dec bc\n");
+        OP(0x0b):
             DEC16(BC);
             cpu_cycles = 8;
             break;
 
         /* INC C */
-        case 0x0c:
-            DEBUG("inc c\n");
+        OP(0x0c):
             INC(c);
             cpu_cycles = 4;
             break;
 
         /* DEC C */
-        case 0x0d:
-            DEBUG("dec c\n");
+        OP(0x0d):
             DEC(c);
             cpu_cycles = 4;
             break;
 
         /* LD C, n */
-        case 0x0e:
-            c = read_byte();
-            DEBUG("ld c, 0x%hhx\n", c);
+        OP(0x0e):
+            c = IMM8();
             cpu_cycles = 8;
             break;
 
         /* RRCA */
-        case 0x0f:
-            DEBUG("rrca\n");
-            COND_FLAG(C, (a & 1));
-            a = ROR(a);
-            COND_FLAG(Z, (a == 0));
-            CLEAR_FLAG(N);
-            CLEAR_FLAG(H);
+        OP(0x0f):
+            RRC(a);
+            flags &= C_FLAG;
             cpu_cycles = 4;
             break;
 
         /* LD DE, nn */
-        case 0x11:
+        OP(0x11):
         {
-            unsigned short tmp = read_word();
-            DEBUG("ld de, 0x%hx\n", tmp);
+            unsigned short tmp = IMM16();
             SET_DE(tmp);
             cpu_cycles = 12;
             break;
         }
 
         /* LD (DE), A */
-        case 0x12:
-            DEBUG("ld (de), a\n");
-            set_mem16(GET_DE(), a);
+        OP(0x12):
+            set_mem8(GET_DE(), a);
             cpu_cycles = 8;
             break;
 
         /* INC DE */
-        case 0x13:
-            DEBUG("inc de\n");
+        OP(0x13):
             INC16(DE);
             cpu_cycles = 8;
             break;
 
         /* INC D */
-        case 0x14:
-            DEBUG("inc d\n");
+        OP(0x14):
             INC(d);
             cpu_cycles = 4;
             break;
 
         /* DEC D */
-        case 0x15:
-            DEBUG("dec d\n");
+        OP(0x15):
             DEC(d);
             cpu_cycles = 4;
             break;
 
         /* LD D, n */
-        case 0x16:
-            d = read_byte();
-            DEBUG("ld d, 0x%hhx\n", d);
+        OP(0x16):
+            d = IMM8();
             cpu_cycles = 8;
             break;
 
         /* RLA */
-        case 0x17:
-            DEBUG("rla\n");
+        OP(0x17):
             RL(a);
+            flags &= C_FLAG;
             cpu_cycles = 4;
             break;
 
         /* JR n */
-        case 0x18:
+        OP(0x18):
         {
-            char tmp = read_byte();
-            DEBUG("jr 0x%hhx\n", tmp);
+            char tmp = IMM8();
             pc += tmp;
-            cpu_cycles = 8;
+            cpu_cycles = 12;
             break;
         }
 
         /* ADD HL, DE */
-        case 0x19:
-            DEBUG("add hl, de\n");
+        OP(0x19):
             ADD16(HL, DE);
             cpu_cycles = 8;
             break;
 
         /* LD A, (DE) */
-        case 0x1a:
-            DEBUG("ld a, (de)\n");
+        OP(0x1a):
             a = get_mem8(GET_DE());
             cpu_cycles = 8;
             break;
 
         /* DEC DE */
-        case 0x1b:
-            DEBUG("dec de\n");
+        OP(0x1b):
             DEC16(DE);
             cpu_cycles = 8;
             break;
 
         /* INC E */
-        case 0x1c:
-            DEBUG("inc e\n");
+        OP(0x1c):
             INC(e);
             cpu_cycles = 4;
             break;
 
         /* DEC E */
-        case 0x1d:
-            DEBUG("dec e\n");
+        OP(0x1d):
             DEC(e);
             cpu_cycles = 4;
             break;
 
         /* LD E, n */
-        case 0x1e:
-            e = read_byte();
-            DEBUG("ld e, 0x%hhx\n", e);
+        OP(0x1e):
+            e = IMM8();
             cpu_cycles = 8;
             break;
 
         /* RRA */
-        case 0x1f:
-        {
-            char tmp = TEST_FLAG(C);
-            DEBUG("rra\n");
-            COND_FLAG(C, (a & 0x1));
-            a >>= 1;
-            a |= (tmp << 7);
-            COND_FLAG(Z, (a == 0));
-            CLEAR_FLAG(N);
-            CLEAR_FLAG(H);
+        OP(0x1f):
+            RR(a);
+            flags &= C_FLAG;
             cpu_cycles = 4;
             break;
-        }
 
         /* JR NZ, * */
-        case 0x20:
+        OP(0x20):
         {
-            char tmp = read_byte();
-            DEBUG("jr nz, 0x%hhx\n", tmp);
+            char tmp = IMM8();
             if ( ! TEST_FLAG(Z) )
+            {
                 pc += tmp;
-            cpu_cycles = 8;
+                cpu_cycles = 12;
+            }
+            else
+                cpu_cycles = 8;
             break;
         }
 
         /* LD HL, nn */
-        case 0x21:
+        OP(0x21):
         {
-            short tmp = read_word();
-            DEBUG("ld hl, 0x%hx\n", tmp);
+            short tmp = IMM16();
             SET_HL(tmp);
             cpu_cycles = 12;
             break;
         }
 
         /* LDI (HL), A */
-        case 0x22:
-            DEBUG("ldi (hl), a\n");
+        OP(0x22):
             set_mem8(GET_HL(), a);
             SET_HL(GET_HL() + 1);
             cpu_cycles = 8;
             break;
 
         /* INC HL */
-        case 0x23:
-            DEBUG("inc hl\n");
+        OP(0x23):
             SET_HL(GET_HL() + 1);
             cpu_cycles = 8;
             break;
 
         /* INC H */
-        case 0x24:
-            DEBUG("inc h\n");
+        OP(0x24):
             INC(h);
             cpu_cycles = 4;
             break;
 
         /* DEC H */
-        case 0x25:
-            DEBUG("dec h\n");
+        OP(0x25):
             DEC(h);
             cpu_cycles = 4;
             break;
 
         /* LD H, n */
-        case 0x26:
-            h = read_byte();
-            DEBUG("ld h, 0x%hhx\n", h);
+        OP(0x26):
+            h = IMM8();
             cpu_cycles = 8;
             break;
 
         /* DAA */
-        case 0x27:
-            DEBUG("daa\n");
-            /* XXX */
+        OP(0x27):
+        {
+            unsigned short entry = daa_table[DAA_INDEX(GET_FLAGS(), a)];
+            a = entry >> 8;
+            flags = entry & 0xff;
             cpu_cycles = 4;
             break;
+        }
 
         /* JR Z, n */
-        case 0x28:
+        OP(0x28):
         {
-            char tmp = read_byte();
-            DEBUG("jr z, %hhx\n", tmp);
+            char tmp = IMM8();
             if ( TEST_FLAG(Z) )
+            {
                 pc += tmp;
-            cpu_cycles = 8;
+                cpu_cycles = 12;
+            }
+            else
+                cpu_cycles = 8;
             break;
         }
 
         /* ADD HL, HL */
-        case 0x29:
-            DEBUG("add hl, hl\n");
+        OP(0x29):
             ADD16(HL, HL);
             cpu_cycles = 8;
             break;
 
         /* LDI A, (HL) */
-        case 0x2a:
-            DEBUG("ldi a, (hl)\n");
+        OP(0x2a):
             a = get_mem8(GET_HL());
             SET_HL(GET_HL() + 1);
             cpu_cycles = 8;
             break;
 
         /* DEC HL */
-        case 0x2b:
-            DEBUG("dec hl\n");
+        OP(0x2b):
             DEC16(HL);
             cpu_cycles = 8;
             break;
 
         /* INC L */
-        case 0x2c:
-            DEBUG("inc l\n");
+        OP(0x2c):
             INC(l);
             cpu_cycles = 4;
             break;
 
         /* DEC L */
-        case 0x2d:
-            DEBUG("dec l\n");
+        OP(0x2d):
             DEC(l);
             cpu_cycles = 4;
             break;
 
         /* LD L, n */
-        case 0x2e:
+        OP(0x2e):
         {
-            l = read_byte();
-            DEBUG("ld l, 0x%hhx\n", l);
+            l = IMM8();
             cpu_cycles = 8;
             break;
         }
 
         /* CPL */
-        case 0x2f:
-            DEBUG("cpl\n");
+        OP(0x2f):
             a = ~a;
             SET_FLAG(N);
             SET_FLAG(H);
@@ -470,74 +690,72 @@ void exec_instruction ( void )
             break;
 
         /* JR NC, n */
-        case 0x30:
+        OP(0x30):
         {
-            char tmp = read_byte();
-            DEBUG("jr nc, 0x%hhx\n", tmp);
+            char tmp = IMM8();
             if ( ! TEST_FLAG(C) )
+            {
                 pc += tmp;
-            cpu_cycles = 8;
+                cpu_cycles = 12;
+            }
+            else
+                cpu_cycles = 8;
             break;
         }
 
         /* LD SP, nn */
-        case 0x31:
+        OP(0x31):
         {
-            unsigned short tmp = read_word();
-            DEBUG("ld sp, 0x%hx\n", tmp);
+            unsigned short tmp = IMM16();
             sp = tmp;
             cpu_cycles = 12;
             break;
         }
 
         /* LDD (HL), A */
-        case 0x32:
-            DEBUG("ldd (hl), a\n");
+        OP(0x32):
             set_mem8(GET_HL(), a);
             SET_HL(GET_HL() - 1);
             cpu_cycles = 8;
             break;
 
         /* INC SP */
-        case 0x33:
-            DEBUG("inc sp\n");
+        OP(0x33):
             sp++;
             cpu_cycles = 8;
             break;
 
         /* INC (HL) */
-        case 0x34:
-            DEBUG("inc (hl)\n");
-            set_mem8(GET_HL(), get_mem8(GET_HL()) + 1);
-            COND_FLAG(Z, (get_mem8(GET_HL()) == 0));
-            CLEAR_FLAG(N);
-            COND_FLAG(H, HALFCARRY8((get_mem8(GET_HL()) - 1), 1, get_mem8(GET_HL())));
+        OP(0x34):
+        {
+            unsigned char tmp = get_mem8(GET_HL());
+            INC(tmp);
+            set_mem8(GET_HL(), tmp);
             cpu_cycles = 12;
             break;
+        }
 
         /* DEC (HL) */
-        case 0x35:
-            DEBUG("dec (hl)\n");
-            set_mem8(GET_HL(), get_mem8(GET_HL()) - 1);
-            COND_FLAG(Z, (get_mem8(GET_HL()) == 0));
-            SET_FLAG(N);
-            COND_FLAG(H, !HALFBORROW8((get_mem8(GET_HL()) + 1), 1, get_mem8(GET_HL())));
+        OP(0x35):
+        {
+            unsigned char tmp = get_mem8(GET_HL());
+            DEC(tmp);
+            set_mem8(GET_HL(), tmp);
             cpu_cycles = 12;
             break;
+        }
 
         /* LD (HL), n */
-        case 0x36:
+        OP(0x36):
         {
-            unsigned char tmp = read_byte();
-            DEBUG("ld (hl), 0x%hhx\n", tmp);
+            unsigned char tmp = IMM8();
             set_mem8(GET_HL(), tmp);
             cpu_cycles = 12;
             break;
         }
 
         /* SCF */
-        case 0x37:
-            DEBUG("scf\n");
+        OP(0x37):
             CLEAR_FLAG(N);
             CLEAR_FLAG(H);
             SET_FLAG(C);
@@ -545,62 +763,58 @@ void exec_instruction ( void )
             break;
 
         /* JR C, n */
-        case 0x38:
+        OP(0x38):
         {
-            char tmp = read_byte();
-            DEBUG("jr c, 0x%hhx\n", tmp);
+            char tmp = IMM8();
             if ( TEST_FLAG(C) )
+            {
                 pc += tmp;
-            cpu_cycles = 8;
+                cpu_cycles = 12;
+            }
+            else
+                cpu_cycles = 8;
             break;
         }
 
         /* ADD HL, SP */
-        case 0x39:
-            DEBUG("add hl, sp\n");
+        OP(0x39):
             ADD16(HL, SP);
             cpu_cycles = 8;
             break;
 
         /* LDD A, (HL) */
-        case 0x3a:
-            DEBUG("ldd a, (hl)\n");
+        OP(0x3a):
             a = get_mem8(GET_HL());
             SET_HL(GET_HL() - 1);
             cpu_cycles = 8;
             break;
 
         /* DEC SP */
-        case 0x3b:
-            DEBUG("dec sp\n");
+        OP(0x3b):
             sp--;
             cpu_cycles = 8;
             break;
 
         /* INC A */
-        case 0x3c:
-            DEBUG("inc a\n");
+        OP(0x3c):
             INC(a);
             cpu_cycles = 4;
             break;
 
         /* DEC A */
-        case 0x3d:
-            DEBUG("dec a\n");
+        OP(0x3d):
             DEC(a);
             cpu_cycles = 4;
             break;
 
         /* LD A, n */
-        case 0x3e:
-            a = read_byte();
-            DEBUG("ld a, 0x%hhx\n", a);
+        OP(0x3e):
+            a = IMM8();
             cpu_cycles = 8;
             break;
 
         /* CCF */
-        case 0x3f:
-            DEBUG("ccf\n");
+        OP(0x3f):
             CLEAR_FLAG(N);
             CLEAR_FLAG(H);
             COND_FLAG(C, !TEST_FLAG(C));
@@ -608,1487 +822,1290 @@ void exec_instruction ( void )
             break;
 
         /* LD B, B */
-        case 0x40:
-            DEBUG("ld b, b\n");
+        OP(0x40):
             cpu_cycles = 4;
             break;
 
         /* LD B, C */
-        case 0x41:
-            DEBUG("ld b, c\n");
+        OP(0x41):
             b = c;
             cpu_cycles = 4;
             break;
 
         /* LD B, D */
-        case 0x42:
-            DEBUG("ld b, d\n");
+        OP(0x42):
             b = d;
             cpu_cycles = 4;
             break;
 
         /* LD B, E */
-        case 0x43:
-            DEBUG("ld b, e\n");
+        OP(0x43):
             b = e;
             cpu_cycles = 4;
             break;
 
         /* LD B, H */
-        case 0x44:
-            DEBUG("ld b, h\n");
+        OP(0x44):
             b = h;
             cpu_cycles = 4;
             break;
 
         /* LD B, L */
-        case 0x45:
-            DEBUG("ld b, l\n");
+        OP(0x45):
             b = l;
             cpu_cycles = 4;
             break;
 
         /* LD B, (HL) */
-        case 0x46:
-            DEBUG("ld b, (hl)\n");
+        OP(0x46):
             b = get_mem8(GET_HL());
             cpu_cycles = 8;
             break;
 
         /* LD B, A */
-        case 0x47:
-            DEBUG("ld b, a\n");
+        OP(0x47):
             b = a;
             cpu_cycles = 4;
             break;
 
         /* LD C, B */
-        case 0x48:
-            DEBUG("ld c, b\n");
+        OP(0x48):
             c = b;
             cpu_cycles = 4;
             break;
 
         /* LD C, C */
-        case 0x49:
-            DEBUG("ld c, c\n");
+        OP(0x49):
             cpu_cycles = 4;
             break;
 
         /* LD C, D */
-        case 0x4a:
-            DEBUG("ld c, d\n");
+        OP(0x4a):
             c = d;
             cpu_cycles = 4;
             break;
 
         /* LD C, E */
-        case 0x4b:
-            DEBUG("ld c, e\n");
+        OP(0x4b):
             c = e;
             cpu_cycles = 4;
             break;
 
         /* LD C, H */
-        case 0x4c:
-            DEBUG("ld c, h\n");
+        OP(0x4c):
             c = h;
             cpu_cycles = 4;
             break;
 
         /* LD C, L */
-        case 0x4d:
-            DEBUG("ld c, l\n");
+        OP(0x4d):
             c = l;
             cpu_cycles = 4;
             break;
 
         /* LD C, (HL) */
-        case 0x4e:
-            DEBUG("ld c, (hl)\n");
+        OP(0x4e):
             c = get_mem8(GET_HL());
             cpu_cycles = 8;
             break;
 
         /* LD C, A */
-        case 0x4f:
-            DEBUG("ld c, a\n");
+        OP(0x4f):
             c = a;
             cpu_cycles = 4;
             break;
 
         /* LD D, B */
-        case 0x50:
-            DEBUG("ld d, b\n");
+        OP(0x50):
             d = b;
             cpu_cycles = 4;
             break;
 
         /* LD D, C */
-        case 0x51:
-            DEBUG("ld d, c\n");
+        OP(0x51):
             d = c;
             cpu_cycles = 4;
             break;
 
         /* LD D, D */
-        case 0x52:
-            DEBUG("ld d, d\n");
+        OP(0x52):
             cpu_cycles = 4;
             break;
 
         /* LD D, E */
-        case 0x53:
-            DEBUG("ld d, e\n");
+        OP(0x53):
             d = e;
             cpu_cycles = 4;
             break;
 
         /* LD D, H */
-        case 0x54:
-            DEBUG("ld d, h\n");
+        OP(0x54):
             d = h;
             cpu_cycles = 4;
             break;
 
         /* LD D, L */
-        case 0x55:
-            DEBUG("ld d, l\n");
+        OP(0x55):
             d = l;
             cpu_cycles = 4;
             break;
 
         /* LD D, (HL) */
-        case 0x56:
-            DEBUG("ld d, (hl)\n");
+        OP(0x56):
             d = get_mem8(GET_HL());
             cpu_cycles = 8;
             break;
 
         /* LD D, A */
-        case 0x57:
-            DEBUG("ld d, a\n");
+        OP(0x57):
             d = a;
             cpu_cycles = 4;
             break;
 
         /* LD E, B */
-        case 0x58:
-            DEBUG("ld e, b\n");
+        OP(0x58):
             e = b;
             cpu_cycles = 4;
             break;
 
         /* LD E, C */
-        case 0x59:
-            DEBUG("e, c\n");
+        OP(0x59):
             e = c;
             cpu_cycles = 4;
             break;
 
         /* LD E, D */
-        case 0x5a:
-            DEBUG("ld e, d\n");
+        OP(0x5a):
             e = d;
             cpu_cycles = 4;
             break;
 
         /* LD E, E */
-        case 0x5b:
-            DEBUG("ld e, e\n");
+        OP(0x5b):
             cpu_cycles = 4;
             break;
 
         /* LD E, H */
-        case 0x5c:
-            DEBUG("ld e, h\n");
+        OP(0x5c):
             e = h;
             cpu_cycles = 4;
             break;
 
         /* LD E, L */
-        case 0x5d:
-            DEBUG("ld e, l\n");
+        OP(0x5d):
             e = l;
             cpu_cycles = 4;
             break;
 
         /* LD E, (HL) */
-        case 0x5e:
-            DEBUG("ld e, (hl)\n");
+        OP(0x5e):
             e = get_mem8(GET_HL());
             cpu_cycles = 8;
             break;
 
         /* LD E, A */
-        case 0x5f:
-            DEBUG("ld e, a\n");
+        OP(0x5f):
             e = a;
             cpu_cycles = 4;
             break;
 
         /* LD H, B */
-        case 0x60:
-            DEBUG("ld h, b\n");
+        OP(0x60):
             h = b;
             cpu_cycles = 4;
             break;
 
         /* LD H, C */
-        case 0x61:
-            DEBUG("ld h, c\n");
+        OP(0x61):
             h = c;
             cpu_cycles = 4;
             break;
 
         /* LD H, D */
-        case 0x62:
-            DEBUG("ld h, d\n");
+        OP(0x62):
             h = d;
             cpu_cycles = 4;
             break;
 
         /* LD H, E */
-        case 0x63:
-            DEBUG("ld h, e\n");
+        OP(0x63):
             h = e;
             cpu_cycles = 4;
             break;
 
         /* LD H, H */
-        case 0x64:
-            DEBUG("ld h, h\n");
+        OP(0x64):
             cpu_cycles = 4;
             break;
 
         /* LD H, L */
-        case 0x65:
-            DEBUG("ld h, l\n");
+        OP(0x65):
             h = l;
             cpu_cycles = 4;
             break;
 
         /* LD H, (HL) */
-        case 0x66:
-            DEBUG("ld h, (hl)\n");
+        OP(0x66):
             h = get_mem8(GET_HL());
             cpu_cycles = 8;
             break;
 
         /* LD H, A */
-        case 0x67:
-            DEBUG("ld h, a\n");
+        OP(0x67):
             h = a;
             cpu_cycles = 4;
             break;
 
         /* LD L, B */
-        case 0x68:
-            DEBUG("ld l, b\n");
+        OP(0x68):
             l = b;
             cpu_cycles = 4;
             break;
 
         /* LD L, C */
-        case 0x69:
-            DEBUG("ld l, c\n");
+        OP(0x69):
             l = c;
             cpu_cycles = 4;
             break;
 
         /* LD L, D */
-        case 0x6a:
-            DEBUG("ld l, d\n");
+        OP(0x6a):
             l = d;
             cpu_cycles = 4;
             break;
 
         /* LD L, E */
-        case 0x6b:
-            DEBUG("ld l, e\n");
+        OP(0x6b):
             l = e;
             cpu_cycles = 4;
             break;
 
         /* LD L, H */
-        case 0x6c:
-            DEBUG("ld l, h\n");
+        OP(0x6c):
             l = h;
             cpu_cycles = 4;
             break;
 
         /* LD L, L */
-        case 0x6d:
-            DEBUG("ld l, l\n");
+        OP(0x6d):
             cpu_cycles = 4;
             break;
 
         /* LD L, (HL) */
-        case 0x6e:
-            DEBUG("ld l, (hl)\n");
+        OP(0x6e):
             l = get_mem8(GET_HL());
             cpu_cycles = 8;
             break;
 
         /* LD L, A */
-        case 0x6f:
-            DEBUG("ld l, a\n");
+        OP(0x6f):
             l = a;
             cpu_cycles = 4;
             break;
 
         /* LD (HL), B */
-        case 0x70:
-            DEBUG("ld (hl), b\n");
+        OP(0x70):
             set_mem8(GET_HL(), b);
             cpu_cycles = 8;
             break;
 
         /* LD (HL), C */
-        case 0x71:
-            DEBUG("ld (hl), c\n");
+        OP(0x71):
             set_mem8(GET_HL(), c);
             cpu_cycles = 8;
             break;
 
         /* LD (HL), D */
-        case 0x72:
-            DEBUG("ld (hl), d\n");
+        OP(0x72):
             set_mem8(GET_HL(), d);
             cpu_cycles = 8;
             break;
 
         /* LD (HL), E */
-        case 0x73:
-            DEBUG("ld (hl), e\n");
+        OP(0x73):
             set_mem8(GET_HL(), e);
             cpu_cycles = 8;
             break;
 
         /* LD (HL), H */
-        case 0x74:
-            DEBUG("ld (hl), h\n");
+        OP(0x74):
             set_mem8(GET_HL(), h);
             cpu_cycles = 8;
             break;
 
         /* LD (HL), L */
-        case 0x75:
-            DEBUG("ld (hl), l\n");
+        OP(0x75):
             set_mem8(GET_HL(), l);
             cpu_cycles = 8;
             break;
 
         /* HALT */
-        case 0x76:
-            DEBUG("halt\n");
-            /* XXX */
+        OP(0x76):
+            halt = 1;
             cpu_cycles = 4;
             break;
 
         /* LD (HL), A */
-        case 0x77:
-            DEBUG("ld (hl), a\n");
+        OP(0x77):
             set_mem8(GET_HL(), a);
             cpu_cycles = 8;
             break;
 
         /* LD A, B */
-        case 0x78:
-            DEBUG("ld a, b\n");
+        OP(0x78):
             a = b;
             cpu_cycles = 4;
             break;
 
         /* LD A, C */
-        case 0x79:
-            DEBUG("ld a, c\n");
+        OP(0x79):
             a = c;
             cpu_cycles = 4;
             break;
 
         /* LD A, D */
-        case 0x7a:
-            DEBUG("ld a, d\n");
+        OP(0x7a):
             a = d;
             cpu_cycles = 4;
             break;
 
         /* LD A, E */
-        case 0x7b:
-            DEBUG("ld a, e\n");
+        OP(0x7b):
             a = e;
             cpu_cycles = 4;
             break;
 
         /* LD A, H */
-        case 0x7c:
-            DEBUG("ld a, h\n");
+        OP(0x7c):
             a = h;
             cpu_cycles = 4;
             break;
 
         /* LD A, L */
-        case 0x7d:
-            DEBUG("ld a, l\n");
+        OP(0x7d):
             a = l;
             cpu_cycles = 4;
             break;
 
         /* LD A, (HL) */
-        case 0x7e:
-            DEBUG("ld a, (hl)\n");
+        OP(0x7e):
             a = get_mem8(GET_HL());
             cpu_cycles = 8;
             break;
 
         /* LD A, A */
-        case 0x7f:
-            DEBUG("ld a, a\n");
+        OP(0x7f):
             cpu_cycles = 4;
             break;
 
         /* ADD A, B */
-        case 0x80:
-            DEBUG("add a, b\n");
+        OP(0x80):
             ADD(a, b);
             cpu_cycles = 4;
             break;
 
         /* ADD A, C */
-        case 0x81:
-            DEBUG("add a, c\n");
+        OP(0x81):
             ADD(a, c);
             cpu_cycles = 4;
             break;
 
         /* ADD A, D */
-        case 0x82:
-            DEBUG("add a, d\n");
+        OP(0x82):
             ADD(a, d);
             cpu_cycles = 4;
             break;
 
         /* ADD A, E */
-        case 0x83:
-            DEBUG("add a, e\n");
+        OP(0x83):
             ADD(a, e);
             cpu_cycles = 4;
             break;
 
         /* ADD A, H */
-        case 0x84:
-            DEBUG("add a, h\n");
+        OP(0x84):
             ADD(a, h);
             cpu_cycles = 4;
             break;
 
         /* ADD A, L */
-        case 0x85:
-            DEBUG("add a, l\n");
+        OP(0x85):
             ADD(a, l);
             cpu_cycles = 4;
             break;
 
         /* ADD A, (HL) */
-        case 0x86:
-            DEBUG("add a, (hl)\n");
+        OP(0x86):
             ADD(a, get_mem8(GET_HL()));
             cpu_cycles = 8;
             break;
 
         /* ADD A, A */
-        case 0x87:
-            DEBUG("add a, a\n");
+        OP(0x87):
             ADD(a, a);
             cpu_cycles = 4;
             break;
 
         /* ADC A, B */
-        case 0x88:
-            DEBUG("adc a, b\n");
+        OP(0x88):
             ADC(a, b);
             cpu_cycles = 4;
             break;
 
         /* ADC A, C */
-        case 0x89:
-            DEBUG("adc a, c\n");
+        OP(0x89):
             ADC(a, c);
             cpu_cycles = 4;
             break;
 
         /* ADC A, D */
-        case 0x8a:
-            DEBUG("adc a, d\n");
+        OP(0x8a):
             ADC(a, d);
             cpu_cycles = 4;
             break;
 
         /* ADC A, E */
-        case 0x8b:
-            DEBUG("adc a, e\n");
+        OP(0x8b):
             ADC(a, e);
             cpu_cycles = 4;
             break;
 
         /* ADC A, H */
-        case 0x8c:
-            DEBUG("adc a, h\n");
+        OP(0x8c):
             ADC(a, h);
             cpu_cycles = 4;
             break;
 
         /* ADC A, L */
-        case 0x8d:
-            DEBUG("adc a, l\n");
+        OP(0x8d):
             ADC(a, l);
             cpu_cycles = 4;
             break;
 
         /* ADC A, (HL) */
-        case 0x8e:
-            DEBUG("adc a, (hl)\n");
+        OP(0x8e):
             ADC(a, get_mem8(GET_HL()));
             cpu_cycles = 8;
             break;
 
         /* ADC A, A */
-        case 0x8f:
-            DEBUG("adc a, a\n");
+        OP(0x8f):
             ADC(a, a);
             cpu_cycles = 4;
             break;
 
         /* SUB B */
-        case 0x90:
-            DEBUG("sub b\n");
+        OP(0x90):
             SUB(a, b);
             cpu_cycles = 4;
             break;
 
         /* SUB C */
-        case 0x91:
-            DEBUG("sub c\n");
+        OP(0x91):
             SUB(a, c);
             cpu_cycles = 4;
             break;
 
         /* SUB D */
-        case 0x92:
-            DEBUG("sub d\n");
+        OP(0x92):
             SUB(a, d);
             cpu_cycles = 4;
             break;
 
         /* SUB E */
-        case 0x93:
-            DEBUG("sub e\n");
+        OP(0x93):
             SUB(a, e);
             cpu_cycles = 4;
             break;
 
         /* SUB H */
-        case 0x94:
-            DEBUG("sub h\n");
+        OP(0x94):
             SUB(a, h);
             cpu_cycles = 4;
             break;
 
         /* SUB L */
-        case 0x95:
-            DEBUG("sub l\n");
+        OP(0x95):
             SUB(a, l);
             cpu_cycles = 4;
             break;
 
         /* SUB (HL) */
-        case 0x96:
-            DEBUG("sub (hl)\n");
+        OP(0x96):
             SUB(a, get_mem8(GET_HL()));
             cpu_cycles = 8;
             break;
 
         /* SUB A */
-        case 0x97:
-            DEBUG("sub a\n");
+        OP(0x97):
             SUB(a, a);
             cpu_cycles = 4;
             break;
 
         /* SBC A, B */
-        case 0x98:
-            DEBUG("sbc a, b\n");
+        OP(0x98):
             SBC(a, b);
             cpu_cycles = 4;
             break;
 
         /* SBC A, C */
-        case 0x99:
-            DEBUG("sbc a, c\n");
+        OP(0x99):
             SBC(a, c);
             cpu_cycles = 4;
             break;
 
         /* SBC A, D */
-        case 0x9a:
-            DEBUG("sbc a, d\n");
+        OP(0x9a):
             SBC(a, d);
             cpu_cycles = 4;
             break;
 
         /* SBC A, E */
-        case 0x9b:
-            DEBUG("sbc a, e\n");
+        OP(0x9b):
             SBC(a, e);
             cpu_cycles = 4;
             break;
 
         /* SBC A, H */
-        case 0x9c:
-            DEBUG("sbc a, h\n");
+        OP(0x9c):
             SBC(a, h);
             cpu_cycles = 4;
             break;
 
         /* SBC A, L */
-        case 0x9d:
-            DEBUG("a, l\n");
-            SBC(a, h);
+        OP(0x9d):
+            SBC(a, l);
             cpu_cycles = 4;
             break;
 
         /* SBC A, (HL) */
-        case 0x9e:
-            DEBUG("sbc a, (hl)\n");
+        OP(0x9e):
             SBC(a, get_mem8(GET_HL()));
             cpu_cycles = 8;
             break;
 
         /* SBC A, A */
-        case 0x9f:
-            DEBUG("sbc a, a\n");
+        OP(0x9f):
             SBC(a, a);
             cpu_cycles = 4;
             break;
 
         /* AND B */
-        case 0xa0:
-            DEBUG("and b\n");
+        OP(0xa0):
             BITWISE(a, b, &=, 1);
             cpu_cycles = 4;
             break;
 
         /* AND C */
-        case 0xa1:
-            DEBUG("and c\n");
+        OP(0xa1):
             BITWISE(a, c, &=, 1);
             cpu_cycles = 4;
             break;
 
         /* AND D */
-        case 0xa2:
-            DEBUG("and d\n");
+        OP(0xa2):
             BITWISE(a, d, &=, 1);
             cpu_cycles = 4;
             break;
 
         /* AND E */
-        case 0xa3:
-            DEBUG("and e\n");
+        OP(0xa3):
             BITWISE(a, e, &=, 1);
             cpu_cycles = 4;
             break;
 
         /* AND H */
-        case 0xa4:
-            DEBUG("and h\n");
+        OP(0xa4):
             BITWISE(a, h, &=, 1);
             cpu_cycles = 4;
             break;
 
         /* AND L */
-        case 0xa5:
-            DEBUG("and l\n");
+        OP(0xa5):
             BITWISE(a, l, &=, 1);
             cpu_cycles = 4;
             break;
 
         /* AND (HL) */
-        case 0xa6:
-            DEBUG("and (hl)\n");
+        OP(0xa6):
             BITWISE(a, get_mem8(GET_HL()), &=, 1);
             cpu_cycles = 8;
             break;
 
         /* AND A */
-        case 0xa7:
-            DEBUG("and a\n");
+        OP(0xa7):
             BITWISE(a, a, &=, 1);
             cpu_cycles = 4;
             break;
 
         /* XOR B */
-        case 0xa8:
-            DEBUG("xor b\n");
+        OP(0xa8):
             BITWISE(a, b, ^=, 0);
             cpu_cycles = 4;
             break;
 
         /* XOR C */
-        case 0xa9:
-            DEBUG("xor c\n");
+        OP(0xa9):
             BITWISE(a, c, ^=, 0);
             cpu_cycles = 4;
             break;
 
         /* XOR D */
-        case 0xaa:
-            DEBUG("xor d\n");
+        OP(0xaa):
             BITWISE(a, d, ^=, 0);
             cpu_cycles = 4;
             break;
 
         /* XOR E */
-        case 0xab:
-            DEBUG("xor e\n");
+        OP(0xab):
             BITWISE(a, e, ^=, 0);
             cpu_cycles = 4;
             break;
 
         /* XOR H */
-        case 0xac:
-            DEBUG("xor h\n");
+        OP(0xac):
             BITWISE(a, h, ^=, 0);
             cpu_cycles = 4;
             break;
 
         /* XOR L */
-        case 0xad:
-            DEBUG("xor l\n");
+        OP(0xad):
             BITWISE(a, l, ^=, 0);
             cpu_cycles = 4;
             break;
 
         /* XOR (HL) */
-        case 0xae:
-            DEBUG("xor (hl)\n");
+        OP(0xae):
             BITWISE(a, get_mem8(GET_HL()), ^=, 0);
             cpu_cycles = 8;
             break;
 
         /* XOR A */
-        case 0xaf:
-            DEBUG("xor a\n");
+        OP(0xaf):
             BITWISE(a, a, ^=, 0);
             cpu_cycles = 4;
             break;
 
         /* OR B */
-        case 0xb0:
-            DEBUG("or b\n");
+        OP(0xb0):
             BITWISE(a, b, |=, 0);
             cpu_cycles = 4;
             break;
 
         /* OR C */
-        case 0xb1:
-            DEBUG("or c\n");
+        OP(0xb1):
             BITWISE(a, c, |=, 0);
             cpu_cycles = 4;
             break;
 
         /* OR D */
-        case 0xb2:
-            DEBUG("or d\n");
+        OP(0xb2):
             BITWISE(a, d, |=, 0);
             cpu_cycles = 4;
             break;
 
         /* OR E */
-        case 0xb3:
-            DEBUG("or e\n");
+        OP(0xb3):
             BITWISE(a, e, |=, 0);
             cpu_cycles = 4;
             break;
 
         /* OR H */
-        case 0xb4:
-            DEBUG("or h\n");
+        OP(0xb4):
             BITWISE(a, h, |=, 0);
             cpu_cycles = 4;
             break;
 
         /* OR L */
-        case 0xb5:
-            DEBUG("or l\n");
+        OP(0xb5):
             BITWISE(a, l, |=, 0);
             cpu_cycles = 4;
             break;
 
         /* OR (HL) */
-        case 0xb6:
-            DEBUG("or (hl)\n");
+        OP(0xb6):
             BITWISE(a, get_mem8(GET_HL()), |=, 0);
             cpu_cycles = 8;
             break;
 
         /* OR A */
-        case 0xb7:
-            DEBUG("or a\n");
+        OP(0xb7):
             BITWISE(a, a, |=, 0);
             cpu_cycles = 4;
             break;
 
         /* CP B */
-        case 0xb8:
-            DEBUG("cp b\n");
+        OP(0xb8):
             COMP(a, b);
             cpu_cycles = 4;
             break;
 
         /* CP C */
-        case 0xb9:
-            DEBUG("cp c\n");
+        OP(0xb9):
             COMP(a, c);
             cpu_cycles = 4;
             break;
 
         /* CP D */
-        case 0xba:
-            DEBUG("cp d\n");
+        OP(0xba):
             COMP(a, d);
             cpu_cycles = 4;
             break;
 
         /* CP E */
-        case 0xbb:
-            DEBUG("cp e\n");
+        OP(0xbb):
             COMP(a, e);
             cpu_cycles = 4;
             break;
 
         /* CP H */
-        case 0xbc:
-            DEBUG("cp h\n");
+        OP(0xbc):
             COMP(a, h);
             cpu_cycles = 4;
             break;
 
         /* CP L */
-        case 0xbd:
-            DEBUG("cp l\n");
+        OP(0xbd):
             COMP(a, l);
             cpu_cycles = 4;
             break;
 
         /* CP (HL) */
-        case 0xbe:
-            DEBUG("cp (hl)\n");
+        OP(0xbe):
             COMP(a, get_mem8(GET_HL()));
             cpu_cycles = 8;
             break;
 
         /* CP A */
-        case 0xbf:
-            DEBUG("cp a\n");
+        OP(0xbf):
             COMP(a, a);
             cpu_cycles = 4;
             break;
 
         /* RET NZ */
-        case 0xc0:
-            DEBUG("ret nz\n");
+        OP(0xc0):
             if ( ! TEST_FLAG(Z) )
+            {
                 RET();
-            cpu_cycles = 8;
+                cpu_cycles = 20;
+            }
+            else
+                cpu_cycles = 8;
             break;
 
         /* POP BC */
-        case 0xc1:
-            DEBUG("pop bc\n");
+        OP(0xc1):
             POP(BC);
             cpu_cycles = 12;
             break;
 
         /* JP NZ, nn */
-        case 0xc2:
+        OP(0xc2):
         {
-            unsigned short tmp = read_word();
-            DEBUG("jp nz, 0x%hx\n", tmp);
+            unsigned short tmp = IMM16();
             if ( ! TEST_FLAG(Z) )
+            {
                 pc = tmp;
-            cpu_cycles = 12;
+                cpu_cycles = 16;
+            }
+            else
+                cpu_cycles = 12;
             break;
         }
 
         /* JP nn */
-        case 0xc3:
-            pc = read_word();
-            DEBUG("jp 0x%hx\n", pc);
-            cpu_cycles = 12;
+        OP(0xc3):
+            pc = IMM16();
+            cpu_cycles = 16;
             break;
 
         /* CALL NZ, nn */
-        case 0xc4:
+        OP(0xc4):
         {
-            unsigned short tmp = read_word();
-            DEBUG("call nz, 0x%hx\n", tmp);
+            unsigned short tmp = IMM16();
             if ( ! TEST_FLAG(Z) )
+            {
                 CALL(tmp);
-            cpu_cycles = 12;
+                cpu_cycles = 24;
+            }
+            else
+                cpu_cycles = 12;
             break;
         }
 
         /* PUSH BC */
-        case 0xc5:
-            DEBUG("push bc\n");
+        OP(0xc5):
             PUSH(GET_BC());
             cpu_cycles = 16;
             break;
 
         /* ADD A, n */
-        case 0xc6:
+        OP(0xc6):
         {
-            unsigned char tmp = read_byte();
-            DEBUG("add a, 0x%hhx\n", tmp);
+            unsigned char tmp = IMM8();
             ADD(a, tmp);
             cpu_cycles = 8;
             break;
         }
 
         /* RST 00H */
-        case 0xc7:
-            DEBUG("RST 0x0\n");
+        OP(0xc7):
             CALL(0x0);
             cpu_cycles = 32;
             break;
 
         /* RET Z */
-        case 0xc8:
-            DEBUG("ret z\n");
+        OP(0xc8):
             if ( TEST_FLAG(Z) )
+            {
                 RET();
-            cpu_cycles = 8;
+                cpu_cycles = 20;
+            }
+            else
+                cpu_cycles = 8;
             break;
 
         /* RET */
-        case 0xc9:
-            DEBUG("ret\n");
+        OP(0xc9):
             RET();
-            cpu_cycles = 8;
+            cpu_cycles = 16;
             break;
 
         /* JP Z, nn */
-        case 0xca:
+        OP(0xca):
         {
-            unsigned short tmp = read_word();
-            DEBUG("jp z, 0x%hx\n", tmp);
+            unsigned short tmp = IMM16();
             if ( TEST_FLAG(Z) )
+            {
                 pc = tmp;
-            cpu_cycles = 12;
+                cpu_cycles = 16;
+            }
+            else
+                cpu_cycles = 12;
             break;
         }
 
         /* CB prefix */
-        case 0xcb:
-            op = read_byte();
-
-            switch ( op )
+        OP(0xcb):
+            CB_DISPATCH(op)
             {
                 /* RLC B */
-                case 0x00:
-                    DEBUG("rlc b\n");
+                CB_OP(0x00):
                     RLC(b);
                     cpu_cycles = 8;
                     break;
 
                 /* RLC C */
-                case 0x01:
-                    DEBUG("rlc c\n");
+                CB_OP(0x01):
                     RLC(c);
                     cpu_cycles = 8;
                     break;
 
                 /* RLC D */
-                case 0x02:
-                    DEBUG("rlc d\n");
+                CB_OP(0x02):
                     RLC(d);
                     cpu_cycles = 8;
                     break;
 
                 /* RLC E */
-                case 0x03:
-                    DEBUG("rlc e\n");
+                CB_OP(0x03):
                     RLC(e);
                     cpu_cycles = 8;
                     break;
 
                 /* RLC H */
-                case 0x04:
-                    DEBUG("rlc h\n");
+                CB_OP(0x04):
                     RLC(h);
                     cpu_cycles = 8;
                     break;
 
                 /* RLC L */
-                case 0x05:
-                    DEBUG("rlc l\n");
+                CB_OP(0x05):
                     RLC(l);
                     cpu_cycles = 8;
                     break;
 
                 /* RLC (HL) */
-                case 0x06:
-                    DEBUG("rlc (hl)\n");
-                    COND_FLAG(C, (get_mem8(GET_HL()) & 0x80));
-                    set_mem8(GET_HL(), ROL(get_mem8(GET_HL())));
-                    COND_FLAG(Z, (GET_HL() == 0));
-                    CLEAR_FLAG(N);
-                    CLEAR_FLAG(H);
+                CB_OP(0x06):
+                {
+                    unsigned char tmp = get_mem8(GET_HL());
+                    RLC(tmp);
+                    set_mem8(GET_HL(), tmp);
                     cpu_cycles = 16;
                     break;
+                }
 
                 /* RLC A */
-                case 0x07:
-                    DEBUG("rlc a\n");
+                CB_OP(0x07):
                     RLC(a);
                     cpu_cycles = 8;
                     break;
 
                 /* RRC B */
-                case 0x08:
-                    DEBUG("rrc b\n");
+                CB_OP(0x08):
                     RRC(b);
                     cpu_cycles = 8;
                     break;
 
                 /* RRC C */
-                case 0x09:
-                    DEBUG("rrc c\n");
+                CB_OP(0x09):
                     RRC(c);
                     cpu_cycles = 8;
                     break;
 
                 /* RRC D */
-                case 0x0a:
-                    DEBUG("rrc d\n");
+                CB_OP(0x0a):
                     RRC(d);
                     cpu_cycles = 8;
                     break;
 
                 /* RRC E */
-                case 0x0b:
-                    DEBUG("rrc e\n");
+                CB_OP(0x0b):
                     RRC(e);
                     cpu_cycles = 8;
                     break;
 
                 /* RRC H */
-                case 0x0c:
-                    DEBUG("rrc h\n");
+                CB_OP(0x0c):
                     RRC(h);
                     cpu_cycles = 8;
                     break;
 
                 /* RRC L */
-                case 0x0d:
-                    DEBUG("rrc l\n");
+                CB_OP(0x0d):
                     RRC(l);
                     cpu_cycles = 8;
                     break;
 
                 /* RRC (HL) */
-                case 0x0e:
-                    DEBUG("rrc (hl)\n");
-                    COND_FLAG(C, (get_mem8(GET_HL()) & 1));
-                    set_mem8(GET_HL(), ROR(get_mem8(GET_HL())));
-                    COND_FLAG(Z, (GET_HL() == 0));
-                    CLEAR_FLAG(N);
-                    CLEAR_FLAG(H);
+                CB_OP(0x0e):
+                {
+                    unsigned char tmp = get_mem8(GET_HL());
+                    RRC(tmp);
+                    set_mem8(GET_HL(), tmp);
                     cpu_cycles = 16;
                     break;
+                }
 
                 /* RRC A */
-                case 0x0f:
-                    DEBUG("rrc a\n");
+                CB_OP(0x0f):
                     RRC(a);
                     cpu_cycles = 8;
                     break;
 
                 /* RL B */
-                case 0x10:
-                    DEBUG("rl b\n");
+                CB_OP(0x10):
                     RL(b);
                     cpu_cycles = 8;
                     break;
 
                 /* RL C */
-                case 0x11:
-                    DEBUG("rl c\n");
+                CB_OP(0x11):
                     RL(c);
                     cpu_cycles = 8;
                     break;
 
                 /* RL D */
-                case 0x12:
-                    DEBUG("rl d\n");
+                CB_OP(0x12):
                     RL(d);
                     cpu_cycles = 8;
                     break;
 
                 /* RL E */
-                case 0x13:
-                    DEBUG("rl e\n");
+                CB_OP(0x13):
                     RL(e);
                     cpu_cycles = 8;
                     break;
 
                 /* RL H */
-                case 0x14:
-                    DEBUG("rl h\n");
+                CB_OP(0x14):
                     RL(h);
                     cpu_cycles = 8;
                     break;
 
                 /* RL L */
-                case 0x15:
-                    DEBUG("rl l\n");
+                CB_OP(0x15):
                     RL(l);
                     cpu_cycles = 8;
                     break;
 
                 /* RL (HL) */
-                case 0x16:
+                CB_OP(0x16):
                 {
-                    unsigned char tmp = TEST_FLAG(C);
-                    DEBUG("rl (hl)\n");
-                    COND_FLAG(C, (get_mem8(GET_HL()) & 0x80));
-                    set_mem8(GET_HL(), ((get_mem8(GET_HL()) << 1) | tmp));
-                    COND_FLAG(Z, (get_mem8(GET_HL()) == 0));
-                    CLEAR_FLAG(N);
-                    CLEAR_FLAG(H);
+                    unsigned char tmp = get_mem8(GET_HL());
+                    RL(tmp);
+                    set_mem8(GET_HL(), tmp);
                     cpu_cycles = 16;
                     break;
                 }
 
                 /* RL A */
-                case 0x17:
-                    DEBUG("rl a\n");
+                CB_OP(0x17):
                     RL(a);
                     cpu_cycles = 8;
                     break;
 
                 /* RR B */
-                case 0x18:
-                    DEBUG("rr b\n");
+                CB_OP(0x18):
                     RR(b);
                     cpu_cycles = 8;
                     break;
 
                 /* RR C */
-                case 0x19:
-                    DEBUG("rr c\n");
+                CB_OP(0x19):
                     RR(c);
                     cpu_cycles = 8;
                     break;
 
                 /* RR D */
-                case 0x1a:
-                    DEBUG("rr d\n");
+                CB_OP(0x1a):
                     RR(d);
                     cpu_cycles = 8;
                     break;
 
                 /* RR E */
-                case 0x1b:
-                    DEBUG("rr e\n");
+                CB_OP(0x1b):
                     RR(e);
                     cpu_cycles = 8;
                     break;
 
                 /* RR H */
-                case 0x1c:
-                    DEBUG("rr h\n");
+                CB_OP(0x1c):
                     RR(h);
                     cpu_cycles = 8;
                     break;
 
                 /* RR L */
-                case 0x1d:
-                    DEBUG("rr l\n");
+                CB_OP(0x1d):
                     RR(l);
                     cpu_cycles = 8;
                     break;
 
                 /* RR (HL) */
-                case 0x1e:
+                CB_OP(0x1e):
                 {
-                    unsigned char tmp = TEST_FLAG(C);
-                    DEBUG("rr (hl)\n");
-                    COND_FLAG(C, (get_mem8(GET_HL()) & 0x1));
-                    set_mem8(GET_HL(), ((get_mem8(GET_HL()) >> 1) | (tmp << 7)));
-                    COND_FLAG(Z, (get_mem8(GET_HL()) == 0));
-                    CLEAR_FLAG(N);
-                    CLEAR_FLAG(H);
+                    unsigned char tmp = get_mem8(GET_HL());
+                    RR(tmp);
+                    set_mem8(GET_HL(), tmp);
                     cpu_cycles = 16;
                     break;
                 }
 
                 /* RR A */
-                case 0x1f:
-                    DEBUG("rr a\n");
+                CB_OP(0x1f):
                     RR(a);
                     cpu_cycles = 8;
                     break;
 
                 /* SLA B */
-                case 0x20:
-                    DEBUG("sla b\n");
+                CB_OP(0x20):
                     SLA(b);
                     cpu_cycles = 8;
                     break;
 
                 /* SLA C */
-                case 0x21:
-                    DEBUG("sla c\n");
+                CB_OP(0x21):
                     SLA(c);
                     cpu_cycles = 8;
                     break;
 
                 /* SLA D */
-                case 0x22:
-                    DEBUG("sla d\n");
+                CB_OP(0x22):
                     SLA(d);
                     cpu_cycles = 8;
                     break;
 
                 /* SLA E */
-                case 0x23:
-                    DEBUG("sla e\n");
+                CB_OP(0x23):
                     SLA(e);
                     cpu_cycles = 8;
                     break;
 
                 /* SLA H */
-                case 0x24:
-                    DEBUG("sla h\n");
+                CB_OP(0x24):
                     SLA(h);
                     cpu_cycles = 8;
                     break;
 
                 /* SLA L */
-                case 0x25:
-                    DEBUG("sla l\n");
+                CB_OP(0x25):
                     SLA(l);
                     cpu_cycles = 8;
                     break;
 
                 /* SLA (HL) */
-                case 0x26:
+                CB_OP(0x26):
                 {
-                    DEBUG("sla (hl)\n");
-                    COND_FLAG(C, (get_mem8(GET_HL()) & 0x80));
-                    set_mem8(GET_HL(), (get_mem8(GET_HL()) << 1));
-                    COND_FLAG(Z, (get_mem8(GET_HL()) == 0));
-                    CLEAR_FLAG(N);
-                    CLEAR_FLAG(H);
+                    unsigned char tmp = get_mem8(GET_HL());
+                    SLA(tmp);
+                    set_mem8(GET_HL(), tmp);
                     cpu_cycles = 16;
                     break;
                 }
 
                 /* SLA A */
-                case 0x27:
-                    DEBUG("sla a\n");
+                CB_OP(0x27):
                     SLA(a);
                     cpu_cycles = 8;
                     break;
 
                 /* SRA B */
-                case 0x28:
-                    DEBUG("sra b\n");
+                CB_OP(0x28):
                     SRA(b);
                     cpu_cycles = 8;
                     break;
 
                 /* SRA C */
-                case 0x29:
-                    DEBUG("sra c\n");
+                CB_OP(0x29):
                     SRA(c);
                     cpu_cycles = 8;
                     break;
 
                 /* SRA D */
-                case 0x2a:
-                    DEBUG("sra d\n");
+                CB_OP(0x2a):
                     SRA(d);
                     cpu_cycles = 8;
                     break;
 
                 /* SRA E */
-                case 0x2b:
-                    DEBUG("sra e\n");
+                CB_OP(0x2b):
                     SRA(e);
                     cpu_cycles = 8;
                     break;
 
                 /* SRA H */
-                case 0x2c:
-                    DEBUG("sra h\n");
+                CB_OP(0x2c):
                     SRA(h);
                     cpu_cycles = 8;
                     break;
 
                 /* SRA L */
-                case 0x2d:
-                    DEBUG("sra l\n");
+                CB_OP(0x2d):
                     SRA(l);
                     cpu_cycles = 8;
                     break;
 
                 /* SRA (HL) */
-                case 0x2e:
+                CB_OP(0x2e):
                 {
-                    DEBUG("sra (hl)\n");
-                    COND_FLAG(C, (get_mem8(GET_HL()) & 0x1));
-                    set_mem8(GET_HL(), (get_mem8(GET_HL()) >> 1) | (get_mem8(GET_HL()) & 0x80));
-                    COND_FLAG(Z, (get_mem8(GET_HL()) == 0));
-                    CLEAR_FLAG(N);
-                    CLEAR_FLAG(H);
+                    unsigned char tmp = get_mem8(GET_HL());
+                    SRA(tmp);
+                    set_mem8(GET_HL(), tmp);
                     cpu_cycles = 16;
                     break;
                 }
 
                 /* SRA A */
-                case 0x2f:
-                    DEBUG("sra a\n");
+                CB_OP(0x2f):
                     SRA(a);
                     cpu_cycles = 8;
                     break;
 
                 /* SWAP B */
-                case 0x30:
-                    DEBUG("swap b\n");
+                CB_OP(0x30):
                     SWAP(b);
                     cpu_cycles = 8;
                     break;
 
                 /* SWAP C */
-                case 0x31:
-                    DEBUG("swap c\n");
+                CB_OP(0x31):
                     SWAP(c);
                     cpu_cycles = 8;
                     break;
 
                 /* SWAP D */
-                case 0x32:
-                    DEBUG("swap d\n");
+                CB_OP(0x32):
                     SWAP(d);
                     cpu_cycles = 8;
                     break;
 
                 /* SWAP E */
-                case 0x33:
-                    DEBUG("swap e\n");
+                CB_OP(0x33):
                     SWAP(e);
                     cpu_cycles = 8;
                     break;
 
                 /* SWAP H */
-                case 0x34:
-                    DEBUG("swap h\n");
+                CB_OP(0x34):
                     SWAP(h);
                     cpu_cycles = 8;
                     break;
 
                 /* SWAP L */
-                case 0x35:
-                    DEBUG("swap l\n");
+                CB_OP(0x35):
                     SWAP(l);
                     cpu_cycles = 8;
                     break;
 
                 /* SWAP (HL) */
-                case 0x36:
-                    DEBUG("swap (hl)\n");
-                    SET_HL(((GET_HL() & 0xf) << 4) | ((GET_HL() & 0xf0) >> 4));
-                    COND_FLAG(Z, (GET_HL() == 0));
-                    CLEAR_FLAG(N);
-                    CLEAR_FLAG(H);
-                    CLEAR_FLAG(C);
+                CB_OP(0x36):
+                {
+                    unsigned char tmp = get_mem8(GET_HL());
+                    SWAP(tmp);
+                    set_mem8(GET_HL(), tmp);
                     cpu_cycles = 16;
                     break;
+                }
 
                 /* SWAP A */
-                case 0x37:
-                    DEBUG("swap a\n");
+                CB_OP(0x37):
                     SWAP(a);
                     cpu_cycles = 8;
                     break;
 
                 /* SRL B */
-                case 0x38:
-                    DEBUG("srl b\n");
+                CB_OP(0x38):
                     SRL(b);
                     cpu_cycles = 8;
                     break;
 
                 /* SRL C */
-                case 0x39:
-                    DEBUG("srl c\n");
+                CB_OP(0x39):
                     SRL(c);
                     cpu_cycles = 8;
                     break;
 
                 /* SRL D */
-                case 0x3a:
-                    DEBUG("srl d\n");
+                CB_OP(0x3a):
                     SRL(d);
                     cpu_cycles = 8;
                     break;
 
                 /* SRL E */
-                case 0x3b:
-                    DEBUG("srl e\n");
+                CB_OP(0x3b):
                     SRL(e);
                     cpu_cycles = 8;
                     break;
 
                 /* SRL H */
-                case 0x3c:
-                    DEBUG("srl h\n");
+                CB_OP(0x3c):
                     SRL(h);
                     cpu_cycles = 8;
                     break;
 
                 /* SRL L */
-                case 0x3d:
-                    DEBUG("srl l\n");
+                CB_OP(0x3d):
                     SRL(l);
                     cpu_cycles = 8;
                     break;
 
                 /* SRL (HL) */
-                case 0x3e:
+                CB_OP(0x3e):
                 {
-                    DEBUG("srl (hl)\n");
-                    COND_FLAG(C, (get_mem8(GET_HL()) & 0x1));
-                    set_mem8(GET_HL(), (get_mem8(GET_HL()) >> 1));
-                    COND_FLAG(Z, (get_mem8(GET_HL()) == 0));
-                    CLEAR_FLAG(N);
-                    CLEAR_FLAG(H);
+                    unsigned char tmp = get_mem8(GET_HL());
+                    SRL(tmp);
+                    set_mem8(GET_HL(), tmp);
                     cpu_cycles = 16;
                     break;
                 }
 
                 /* SRL A */
-                case 0x3f:
-                    DEBUG("srl a");
+                CB_OP(0x3f):
                     SRL(a);
                     cpu_cycles = 8;
                     break;
 
-                default:
+                CB_DEFAULT:
                 {
                     char reg = op & 0x07;
                     char bit = (op & 0x38) >> 3;
@@ -2097,165 +2114,141 @@ void exec_instruction ( void )
                     switch ( ins )
                     {
                         /* BIT b, r */
-                        case 0:
+                        case 1:
                             switch ( reg )
                             {
                                 /* BIT b, B */
                                 case 0:
-                                    DEBUG("bit %hhu, b\n", bit);
                                     BIT(b, bit);
                                     break;
 
                                 /* BIT b, C */
                                 case 1:
-                                    DEBUG("bit %hhu, c\n", bit);
                                     BIT(c, bit);
                                     break;
 
                                 /* BIT b, D */
                                 case 2:
-                                    DEBUG("bit %hhu, d\n", bit);
                                     BIT(d, bit);
                                     break;
 
                                 /* BIT b, E */
                                 case 3:
-                                    DEBUG("bit %hhu, e\n", bit);
                                     BIT(e, bit);
                                     break;
 
                                 /* BIT b, H */
                                 case 4:
-                                    DEBUG("bit %hhu, h\n", bit);
                                     BIT(h, bit);
                                     break;
 
                                 /* BIT b, L */
                                 case 5:
-                                    DEBUG("bit %hhu, l\n", bit);
                                     BIT(l, bit);
                                     break;
 
                                 /* BIT b, (HL) */
                                 case 6:
-                                    DEBUG("bit %hhu, (hl)\n", bit);
                                     BIT(get_mem8(GET_HL()), bit);
                                     cpu_cycles = 8;
                                     break;
 
                                 /* BIT b, A */
                                 case 7:
-                                    DEBUG("bit %hhu, a\n", bit);
                                     BIT(a, bit);
                                     break;
                             }
                             break;
 
                         /* RES b, r */
-                        case 1:
+                        case 2:
                             switch ( reg )
                             {
                                 /* RES b, B */
                                 case 0:
-                                    DEBUG("res %hhu, b\n", bit);
                                     b = CLEAR_BIT(b, bit);
                                     break;
 
                                 /* RES b, C */
                                 case 1:
-                                    DEBUG("res %hhu, c\n", bit);
                                     c = CLEAR_BIT(c, bit);
                                     break;
 
                                 /* RES b, D */
                                 case 2:
-                                    DEBUG("res %hhu, d\n", bit);
                                     d = CLEAR_BIT(d, bit);
                                     break;
 
                                 /* RES b, E */
                                 case 3:
-                                    DEBUG("res %hhu, e\n", bit);
                                     e = CLEAR_BIT(e, bit);
                                     break;
 
                                 /* RES b, H */
                                 case 4:
-                                    DEBUG("res %hhu, h\n", bit);
                                     h = CLEAR_BIT(h, bit);
                                     break;
 
                                 /* RES b, L */
                                 case 5:
-                                    DEBUG("res %hhu, l\n", bit);
                                     l = CLEAR_BIT(l, bit);
                                     break;
 
                                 /* RES b, (HL) */
                                 case 6:
-                                    DEBUG("res %hhu, (hl)\n", bit);
                                     set_mem8(GET_HL(), CLEAR_BIT(get_mem8(GET_HL()), bit));
                                     cpu_cycles = 8;
                                     break;
 
                                 /* RES b, A */
                                 case 7:
-                                    DEBUG("res %hhu, a\n", bit);
                                     a = CLEAR_BIT(a, bit);
                                     break;
                             }
                             break;
 
                         /* SET b, r */
-                        case 2:
+                        case 3:
                             switch ( reg )
                             {
                                 /* SET b, B */
                                 case 0:
-                                    DEBUG("set %hhu, b\n", bit);
                                     b = SET_BIT(b, bit);
                                     break;
 
                                 /* SET b, C */
                                 case 1:
-                                    DEBUG("set %hhu, c\n", bit);
                                     c = SET_BIT(c, bit);
                                     break;
 
                                 /* SET b, D */
                                 case 2:
-                                    DEBUG("set %hhu, d\n", bit);
                                     d = SET_BIT(d, bit);
                                     break;
 
                                 /* SET b, E */
                                 case 3:
-                                    DEBUG("set %hhu, e\n", bit);
                                     e = SET_BIT(e, bit);
                                     break;
 
                                 /* SET b, H */
                                 case 4:
-                                    DEBUG("set %hhu, h\n", bit);
                                     h = SET_BIT(h, bit);
                                     break;
 
                                 /* SET b, L */
                                 case 5:
-                                    DEBUG("set %hhu, l\n", bit);
                                     l = SET_BIT(l, bit);
                                     break;
 
                                 /* SET b, (HL) */
                                 case 6:
-                                    DEBUG("set %hhu, (hl)\n", bit);
                                     set_mem8(GET_HL(), SET_BIT(get_mem8(GET_HL()), bit));
                                     cpu_cycles = 8;
                                     break;
 
                                 /* SET b, A */
                                 case 7:
-                                    DEBUG("set %hhu, a\n", bit);
                                     a = SET_BIT(a, bit);
                                     break;
                             }
@@ -2267,203 +2260,208 @@ void exec_instruction ( void )
             break;
 
         /* CALL Z, nn */
-        case 0xcc:
+        OP(0xcc):
         {
-            unsigned short tmp = read_word();
-            DEBUG("call z, 0x%hx\n", tmp);
+            unsigned short tmp = IMM16();
             if ( TEST_FLAG(Z) )
+            {
                 CALL(tmp);
-            cpu_cycles = 12;
+                cpu_cycles = 24;
+            }
+            else
+                cpu_cycles = 12;
             break;
         }
 
         /* CALL nn */
-        case 0xcd:
+        OP(0xcd):
         {
-            unsigned short tmp = read_word();
-            DEBUG("call 0x%hx\n", tmp);
+            unsigned short tmp = IMM16();
             CALL(tmp);
-            cpu_cycles = 12;
+            cpu_cycles = 24;
             break;
         }
 
         /* ADC A, n */
-        case 0xce:
+        OP(0xce):
         {
-            unsigned char tmp = read_byte();
-            DEBUG("adc a, 0x%hhx\n", tmp);
+            unsigned char tmp = IMM8();
             ADC(a, tmp);
             cpu_cycles = 8;
             break;
         }
 
         /* RST 08H */
-        case 0xcf:
-            DEBUG("rst 0x8\n");
+        OP(0xcf):
             CALL(0x8);
             cpu_cycles = 32;
             break;
 
         /* RET NC */
-        case 0xd0:
-            DEBUG("ret nc\n");
+        OP(0xd0):
             if ( ! TEST_FLAG(C) )
+            {
                 RET();
-            cpu_cycles = 8;
+                cpu_cycles = 20;
+            }
+            else
+                cpu_cycles = 8;
             break;
 
         /* POP DE */
-        case 0xd1:
-            DEBUG("pop de\n");
+        OP(0xd1):
             POP(DE);
             cpu_cycles = 12;
             break;
 
         /* JP NC, nn */
-        case 0xd2:
+        OP(0xd2):
         {
-            unsigned short tmp = read_word();
-            DEBUG("jp nc, 0x%hx\n", tmp);
+            unsigned short tmp = IMM16();
             if ( ! TEST_FLAG(C) )
+            {
                 pc = tmp;
-            cpu_cycles = 12;
+                cpu_cycles = 16;
+            }
+            else
+                cpu_cycles = 12;
             break;
         }
 
         /* CALL NC, nn */
-        case 0xd4:
+        OP(0xd4):
         {
-            unsigned short tmp = read_word();
-            DEBUG("call nc, 0x%hx\n", tmp);
+            unsigned short tmp = IMM16();
             if ( ! TEST_FLAG(C) )
+            {
                 CALL(tmp);
-            cpu_cycles = 12;
+                cpu_cycles = 24;
+            }
+            else
+                cpu_cycles = 12;
             break;
         }
 
         /* PUSH DE */
-        case 0xd5:
-            DEBUG("push de\n");
+        OP(0xd5):
             PUSH(GET_DE());
             cpu_cycles = 16;
             break;
 
         /* SUB n */
-        case 0xd6:
+        OP(0xd6):
         {
-            unsigned char tmp = read_byte();
-            DEBUG("sub 0x%hhx\n", tmp);
+            unsigned char tmp = IMM8();
             SUB(a, tmp);
             cpu_cycles = 8;
             break;
         }
 
         /* RST 10H */
-        case 0xd7:
-            DEBUG("rst 0x10\n");
+        OP(0xd7):
             CALL(0x10);
             cpu_cycles = 32;
             break;
 
         /* RET C */
-        case 0xd8:
-            DEBUG("ret c\n");
+        OP(0xd8):
             if ( TEST_FLAG(C) )
+            {
                 RET();
-            cpu_cycles = 8;
+                cpu_cycles = 20;
+            }
+            else
+                cpu_cycles = 8;
             break;
 
         /* RETI */
-        case 0xd9:
-            DEBUG("reti\n");
+        OP(0xd9):
             ime = 1;
             RET();
-            cpu_cycles = 8;
+            cpu_cycles = 16;
             break;
 
         /* JP C, nn */
-        case 0xda:
+        OP(0xda):
         {
-            unsigned short tmp = read_word();
-            DEBUG("jp c, 0x%hx\n", tmp);
+            unsigned short tmp = IMM16();
             if ( TEST_FLAG(C) )
+            {
                 pc = tmp;
-            cpu_cycles = 12;
+                cpu_cycles = 16;
+            }
+            else
+                cpu_cycles = 12;
             break;
         }
 
         /* CALL C, nn */
-        case 0xdc:
+        OP(0xdc):
         {
-            unsigned short tmp = read_word();
-            DEBUG("call c, 0x%hx\n", tmp);
+            unsigned short tmp = IMM16();
             if ( TEST_FLAG(C) )
+            {
                 CALL(tmp);
-            cpu_cycles = 12;
+                cpu_cycles = 24;
+            }
+            else
+                cpu_cycles = 12;
             break;
         }
 
         /* RST 18H */
-        case 0xdf:
-            DEBUG("rst 0x18\n");
+        OP(0xdf):
             CALL(0x18);
             cpu_cycles = 32;
             break;
 
         /* LDH (n), A */
-        case 0xe0:
+        OP(0xe0):
         {
-            unsigned char tmp = read_byte();
-            DEBUG("ld (0xff00+0x%hhx), a\n", tmp);
+            unsigned char tmp = IMM8();
             set_mem8(0xff00 | tmp, a);
             cpu_cycles = 12;
             break;
         }
 
         /* POP HL */
-        case 0xe1:
-            DEBUG("pop hl\n");
+        OP(0xe1):
             POP(HL);
             cpu_cycles = 12;
             break;
 
         /* LD (C), A */
-        case 0xe2:
-            DEBUG("ld (0xff00+c), a\n");
+        OP(0xe2):
             set_mem8(0xff00 | c, a);
             cpu_cycles = 8;
             break;
 
         /* PUSH HL */
-        case 0xe5:
-            DEBUG("push hl\n");
+        OP(0xe5):
             PUSH(GET_HL());
             cpu_cycles = 16;
             break;
 
         /* AND n */
-        case 0xe6:
+        OP(0xe6):
         {
-            unsigned char tmp = read_byte();
-            DEBUG("and 0x%hhx\n", tmp);
+            unsigned char tmp = IMM8();
             BITWISE(a, tmp, &=, 1);
             cpu_cycles = 8;
             break;
         }
 
         /* RST 20H */
-        case 0xe7:
-            DEBUG("rst 0x20\n");
+        OP(0xe7):
             CALL(0x20);
             cpu_cycles = 32;
             break;
 
         /* ADD SP, n */
-        case 0xe8:
+        OP(0xe8):
         {
             unsigned short orig = sp;
-            char toadd = read_byte();
-            DEBUG("add sp, 0x%hhx\n", toadd);
+            char toadd = IMM8();
             sp += toadd;
             CLEAR_FLAG(Z);
             CLEAR_FLAG(N);
@@ -2474,100 +2472,88 @@ void exec_instruction ( void )
         }
 
         /* JP (HL) */
-        case 0xe9:
-            DEBUG("jp (hl)\n");
-            pc = get_mem16(GET_HL());
+        OP(0xe9):
+            pc = GET_HL();
             cpu_cycles = 4;
             break;
 
         /* LD (nn), A */
-        case 0xea:
+        OP(0xea):
         {
-            unsigned short tmp = read_word();
-            DEBUG("ld (0x%hx), a\n", tmp);
-            set_mem16(tmp, a);
+            unsigned short tmp = IMM16();
+            set_mem8(tmp, a);
             cpu_cycles = 16;
             break;
         }
 
         /* XOR n */
-        case 0xee:
+        OP(0xee):
         {
-            unsigned char tmp = read_byte();
-            DEBUG("xor 0x%hhx\n", tmp);
+            unsigned char tmp = IMM8();
             BITWISE(a, tmp, ^=, 0);
             cpu_cycles = 8;
             break;
         }
 
         /* RST 28H */
-        case 0xef:
-            DEBUG("rst 0x28\n");
+        OP(0xef):
             CALL(0x28);
             cpu_cycles = 32;
             break;
 
         /* LDH A, (n) */
-        case 0xf0:
+        OP(0xf0):
         {
-            char tmp = read_byte();
-            DEBUG("ld a, (0xff00+0x%hhx)\n", tmp);
+            char tmp = IMM8();
             a = get_mem8(0xff00 | tmp);
             cpu_cycles = 12;
             break;
         }
 
         /* POP AF */
-        case 0xf1:
-            DEBUG("pop af\n");
+        OP(0xf1):
             POP(AF);
             cpu_cycles = 12;
             break;
 
         /* LD A, (C) */
-        case 0xf2:
-            DEBUG("ld a, (0xff00+c)\n");
+        OP(0xf2):
             a = get_mem8(0xff00 | c);
             cpu_cycles = 8;
             break;
 
         /* DI */
-        case 0xf3:
-            DEBUG("di\n");
+        OP(0xf3):
             ime = 0;
             cpu_cycles = 4;
             break;
 
         /* PUSH AF */
-        case 0xf5:
-            DEBUG("push af\n");
+        OP(0xf5):
             PUSH(GET_AF());
             cpu_cycles = 16;
             break;
 
         /* OR n */
-        case 0xf6:
+        OP(0xf6):
         {
-            unsigned char tmp = read_byte();
-            DEBUG("or 0x%hhx\n", tmp);
+            unsigned char tmp = IMM8();
             BITWISE(a, tmp, |=, 0);
             cpu_cycles = 8;
             break;
         }
 
         /* RST 30H */
-        case 0xf7:
-            DEBUG("rst 0x30\n");
+        OP(0xf7):
             CALL(0x30);
             cpu_cycles = 32;
             break;
 
         /* LDHL SP, n */
-        case 0xf8:
+        OP(0xf8):
         {
             unsigned short orig = sp;
-            char added = read_byte();
-            DEBUG("ldhl sp, 0x%hhx\n", added);
+            char added = IMM8();
             SET_HL(sp + added);
             CLEAR_FLAG(Z);
             CLEAR_FLAG(N);
@@ -2578,42 +2564,37 @@ void exec_instruction ( void )
         }
 
         /* LD SP, HL */
-        case 0xf9:
-            DEBUG("ld sp, hl\n");
+        OP(0xf9):
             sp = GET_HL();
             cpu_cycles = 8;
             break;
 
         /* LD A, (nn) */
-        case 0xfa:
+        OP(0xfa):
         {
-            unsigned short tmp = read_word();
-            DEBUG("ld a, (%hx)\n", tmp);
+            unsigned short tmp = IMM16();
             a = get_mem8(tmp);
             cpu_cycles = 16;
             break;
         }
 
         /* EI */
-        case 0xfb:
-            DEBUG("ei\n");
+        OP(0xfb):
             ime = 1;
             cpu_cycles = 4;
             break;
 
         /* CP n */
-        case 0xfe:
+        OP(0xfe):
         {
-            unsigned char tmp = read_byte();
-            DEBUG("cp 0x%hhx (a=%hhx)\n", tmp, a);
+            unsigned char tmp = IMM8();
             COMP(a, tmp);
             cpu_cycles = 8;
             break;
         }
 
         /* RST 38H */
-        case 0xff:
-            DEBUG("rst 0x38\n");
+        OP(0xff):
             CALL(0x38);
             cpu_cycles = 32;
             break;
@@ -2629,7 +2610,42 @@ void exec_instruction ( void )
     return;
 
 INVALID_OP:
-    DEBUG("(bad: %hhx)\n", op);
+    /* Don't leave the previous instruction's count for callers to charge */
+    cpu_cycles = 4;
+    total_cpu_cycles += cpu_cycles;
+    /* Callers step pc past the whole instruction, STOP's operand included,
+     * before running it */
+    fprintf(stderr, "Invalid opcode 0x%02hx at 0x%04hx\n", op, pc - op_info[op].length);
+    if ( trace_enabled )
+        dump_trace();
+}
+
+/* Sleep through HALT until IF & IE is non-zero.  Nothing can wake the CPU
+ * before the next hardware event, so time jumps straight to it instead of
+ * stepping 4 cycles at a time. */
+void exec_halt ( unsigned int budget )
+{
+    if ( irq_pending )
+    {
+        halt = 0;
+        cpu_cycles = 4;
+    }
+    else
+        cpu_cycles = budget > 4 ? budget : 4;
+
+    total_cpu_cycles += cpu_cycles;
+}
+
+/* Fetch, decode and run the instruction at pc */
+void exec_instruction ( void )
+{
+    unsigned short op, imm;
+
+    TRACE();
+
+    op = decode_op(pc, &imm);
+    pc += op_info[op].length;
+    exec_op(op, imm);
 }
 
 void init_cpu ( void )
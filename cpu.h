@@ -1,38 +1,78 @@
 void init_cpu(void);
-char read_byte(void);
+unsigned short decode_op(unsigned short addr, unsigned short *imm);
+void exec_op(unsigned short op, unsigned short imm);
 void exec_instruction(void);
+void exec_halt(unsigned int budget);
+unsigned char sync_flags(void);
+
+/* Static properties of each dispatch index, for decoding ahead of time */
+struct op_info
+{
+    unsigned char length, cycles, kind;
+};
+
+#define OP_INVALID 0x1 /* No handler */
+#define OP_BRANCH  0x2 /* May change pc */
+#define OP_SOLO    0x4 /* Writes memory or changes ime/halt; run on its own */
+
+extern const struct op_info op_info[0x200];
 
 /* CPU run state */
 char halt;
+
+/* Set by ops that write memory or change ime/halt, so the run loop services
+ * interrupts and hardware before running anything else */
+char cpu_sync;
 unsigned int cpu_cycles;
 unsigned int total_cpu_cycles;
 
+/* Cycles already added to total_cpu_cycles for instructions not yet run;
+ * JIT blocks charge their whole cost on entry and set this before each
+ * read, so I/O registers computed from the cycle counter see the time the
+ * interpreter would */
+unsigned int cycles_ahead;
+
+#define CPU_TIME() (total_cpu_cycles - cycles_ahead)
+
 /* General 8-bit data registers */
 unsigned char a, b, c, d, e, h, l, flags;
 
+/*
+ * Lazy flag state.  The 8-bit arithmetic ops only record their operands and
+ * result here; flags is rebuilt from them when something reads it.  Bit 8 of
+ * lazy_res is the carry (or borrow) out, so Z and C can be tested without
+ * rebuilding the whole register.
+ */
+unsigned char flags_lazy;
+unsigned char lazy_src, lazy_arg, lazy_carry;
+unsigned short lazy_res;
+
+#define LAZY_NONE 0
+#define LAZY_ADD  1
+#define LAZY_SUB  2
+#define LAZY_INC  3
+#define LAZY_DEC  4
+
 /* Flow control registers */
 unsigned short pc, sp;
 
 /* Convenience for 16-bit address registers */
 #define GET_PAIR(o, t) ((o << 8) | t)
-#define GET_AF()       GET_PAIR(a, flags)
+#define GET_AF()       GET_PAIR(a, GET_FLAGS())
 #define GET_BC()       GET_PAIR(b, c)
 #define GET_DE()       GET_PAIR(d, e)
 #define GET_HL()       GET_PAIR(h, l)
 #define GET_SP()       sp
 #define GET_PC()       pc
 
-#define SET_PAIR(o, t, v) do { o = (v) >> 8; t = (v) & 0xff; } while (0);
-#define SET_AF(val)       SET_PAIR(a, flags, val)
+#define SET_PAIR(o, t, v) do { o = (v) >> 8; t = (v) & 0xff; } while (0)
+#define SET_AF(val)       do { SET_PAIR(a, flags, (val) & 0xfff0); flags_lazy = LAZY_NONE; } while (0)
 #define SET_BC(val)       SET_PAIR(b, c, val)
 #define SET_DE(val)       SET_PAIR(d, e, val)
 #define SET_HL(val)       SET_PAIR(h, l, val)
 #define SET_SP(val)       sp = val
 #define SET_PC(val)       pc = val
 
-#define ROL(val) ((val << 1) | (val >> (sizeof(val) - 1)))
-#define ROR(val) ((val >> 1) | (val << (sizeof(val) - 1)))
-
 /* Flag bitmasks and respective right shifts for parsing */
 #define Z_FLAG  0x80
 #define N_FLAG  0x40
@@ -43,11 +83,21 @@ unsigned short pc, sp;
 #define H_SHIFT 5
 #define C_SHIFT 4
 
+/* Individual flags straight from the lazy state */
+#define LAZY_Z() (!(lazy_res & 0xff))
+#define LAZY_N() (flags_lazy == LAZY_SUB || flags_lazy == LAZY_DEC)
+#define LAZY_H() HALFCARRY8(lazy_src, lazy_arg, lazy_res)
+#define LAZY_C() ((lazy_res >> 8) & 1)
+
+/* Materialize flags from the last ALU op if it has not been already */
+#define GET_FLAGS()  (flags_lazy ? sync_flags() : flags)
+#define SYNC_FLAGS() do { if ( flags_lazy ) sync_flags(); } while (0)
+
 /* Bit twiddling utils for flags with side-effects */
-#define TEST_FLAG(flag)  ((flags & flag##_FLAG) >> flag##_SHIFT)
-#define SET_FLAG(flag)   (flags |= flag##_FLAG)
-#define CLEAR_FLAG(flag) (flags &= ~flag##_FLAG)
-#define FLIP_FLAG(flag)  (flags ^= flag##_FLAG)
+#define TEST_FLAG(flag)  (flags_lazy ? LAZY_##flag() : ((flags & flag##_FLAG) >> flag##_SHIFT))
+#define SET_FLAG(flag)   do { SYNC_FLAGS(); flags |= flag##_FLAG; } while (0)
+#define CLEAR_FLAG(flag) do { SYNC_FLAGS(); flags &= ~flag##_FLAG; } while (0)
+#define FLIP_FLAG(flag)  do { SYNC_FLAGS(); flags ^= flag##_FLAG; } while (0)
 #define COND_FLAG(flag, cond) do { \
     if ( cond )                         \
         SET_FLAG(flag);                 \
@@ -55,12 +105,19 @@ unsigned short pc, sp;
         CLEAR_FLAG(flag);               \
 } while(0)
 
+/* Overwrite all four flags at once, discarding any lazy state */
+#define SET_FLAGS(z, n, h, c) do {                                       \
+    flags = (!!(z) << Z_SHIFT) | (!!(n) << N_SHIFT) |                    \
+            (!!(h) << H_SHIFT) | (!!(c) << C_SHIFT);                     \
+    flags_lazy = LAZY_NONE;                                              \
+} while (0)
+
 /* Carry and half-carry detection */
 #define CARRY(orig, result)                ((unsigned)orig > (unsigned)result)
 #define BORROW(orig, result)               ((unsigned)result > (unsigned)orig)
-#define HALFCARRY8(orig, added, result)    0 //(((orig ^ added ^ result) & 0x10) >> 4)
+#define HALFCARRY8(orig, added, result)    ((((orig) ^ (added) ^ (result)) & 0x10) >> 4)
 #define HALFCARRY16(orig, added, result)   0
-#define HALFBORROW8(orig, subbed, result)  0
+#define HALFBORROW8(orig, subbed, result)  ((((orig) ^ (subbed) ^ (result)) & 0x10) >> 4)
 #define HALFBORROW16(orig, subbed, result) 0
 
 /* Abstractions for common instructions and operations */
@@ -69,14 +126,19 @@ unsigned short pc, sp;
 #define CALL(addr)  do { PUSH(pc); pc = (addr); } while (0)
 #define RET()       do { pc = get_mem16(sp); sp += 2; } while (0)
 
-#define ADD(to, add) do {                      \
-    char orig = to;                            \
-    char toadd = add;                          \
-    to += toadd;                               \
-    COND_FLAG(Z, (to == 0));                   \
-    CLEAR_FLAG(N);                             \
-    COND_FLAG(H, HALFCARRY8(orig, toadd, to)); \
-    COND_FLAG(C, CARRY(orig, to));             \
+/* 8-bit arithmetic records its operands and leaves flags to sync_flags() */
+#define LAZY_ALU(kind, src, arg, carry, result) do { \
+    lazy_src = src;                                  \
+    lazy_arg = arg;                                  \
+    lazy_carry = carry;                              \
+    lazy_res = result;                               \
+    flags_lazy = kind;                               \
+} while (0)
+
+#define ADD(to, add) do {                                                  \
+    unsigned char toadd = add;                                             \
+    LAZY_ALU(LAZY_ADD, to, toadd, 0, to + toadd);                          \
+    to = lazy_res;                                                         \
 } while (0)
 
 #define ADD16(to, add) do {                             \
@@ -88,134 +150,70 @@ unsigned short pc, sp;
     COND_FLAG(C, CARRY(orig, GET_##to()));              \
 } while (0)
 
-#define ADC(to, add) do {                      \
-    char orig = to;                            \
-    char toadd = add + TEST_FLAG(C);           \
-    to += toadd;                               \
-    COND_FLAG(Z, (to == 0));                   \
-    CLEAR_FLAG(N);                             \
-    COND_FLAG(H, HALFCARRY8(orig, toadd, to)); \
-    COND_FLAG(C, CARRY(orig, to));             \
+#define ADC(to, add) do {                                                  \
+    unsigned char toadd = add;                                             \
+    unsigned char carry = TEST_FLAG(C);                                    \
+    LAZY_ALU(LAZY_ADD, to, toadd, carry, to + toadd + carry);              \
+    to = lazy_res;                                                         \
 } while (0)
 
-#define SUB(to, sub) do {                        \
-    char orig = to;                              \
-    char tosub = sub;                            \
-    to -= tosub;                                 \
-    COND_FLAG(Z, (to == 0));                     \
-    SET_FLAG(N);                                 \
-    COND_FLAG(H, !HALFBORROW8(orig, tosub, to)); \
-    COND_FLAG(C, !BORROW(orig, to));             \
+/* Subtraction wraps negative, which leaves the borrow in bit 8 of lazy_res */
+#define SUB(to, sub) do {                                                  \
+    unsigned char tosub = sub;                                             \
+    LAZY_ALU(LAZY_SUB, to, tosub, 0, to - tosub);                          \
+    to = lazy_res;                                                         \
 } while (0)
 
-#define SBC(to, sub) do {                        \
-    char orig = to;                              \
-    char tosub = sub + TEST_FLAG(C);             \
-    to -= tosub;                                 \
-    COND_FLAG(Z, (to == 0));                     \
-    SET_FLAG(N);                                 \
-    COND_FLAG(H, !HALFBORROW8(orig, tosub, to)); \
-    COND_FLAG(C, !BORROW(orig, to));             \
+#define SBC(to, sub) do {                                                  \
+    unsigned char tosub = sub;                                             \
+    unsigned char carry = TEST_FLAG(C);                                    \
+    LAZY_ALU(LAZY_SUB, to, tosub, carry, to - tosub - carry);              \
+    to = lazy_res;                                                         \
 } while (0)
 
 #define BITWISE(to, from, op, hf) do { \
     (to) op (from);                    \
-    COND_FLAG(Z, ((to) == 0));         \
-    CLEAR_FLAG(N);                     \
-    COND_FLAG(H, hf);                  \
-    CLEAR_FLAG(C);                     \
-} while (0)
-
-#define COMP(to, from) do {                       \
-    char result = to - from;                      \
-    COND_FLAG(Z, (result == 0));                  \
-    SET_FLAG(N);                                  \
-    COND_FLAG(H, !HALFBORROW8(to, from, result)); \
-    COND_FLAG(C, !BORROW(to, result));            \
+    SET_FLAGS(((to) == 0), 0, hf, 0);  \
 } while (0)
 
-#define INC(to) do {                           \
-    to++;                                      \
-    COND_FLAG(Z, (to == 0));                   \
-    CLEAR_FLAG(N);                             \
-    COND_FLAG(H, HALFCARRY8((to - 1), 1, to)); \
+#define COMP(to, from) do {                                                \
+    unsigned char tocmp = from;                                            \
+    LAZY_ALU(LAZY_SUB, to, tocmp, 0, to - tocmp);                          \
 } while (0)
 
-#define RLC(to) do {           \
-    COND_FLAG(C, (to & 0x80)); \
-    to = ROL(to);              \
-    COND_FLAG(Z, (to == 0));   \
-    CLEAR_FLAG(N);             \
-    CLEAR_FLAG(H);             \
+/* INC and DEC leave C alone, so the old carry is carried over in bit 8 */
+#define INC(to) do {                                                       \
+    unsigned char carry = TEST_FLAG(C);                                    \
+    LAZY_ALU(LAZY_INC, to, 1, carry, ((to + 1) & 0xff) | (carry << 8));    \
+    to = lazy_res;                                                         \
 } while (0)
 
-#define RL(to) do {            \
-    char tmp = TEST_FLAG(C);   \
-    COND_FLAG(C, (to & 0x80)); \
-    to = ((to << 1) | tmp);    \
-    COND_FLAG(Z, (to == 0));   \
-    CLEAR_FLAG(N);             \
-    CLEAR_FLAG(H);             \
+/* Rotates, shifts and SWAP load result and flags from shift_table */
+#define SHIFT(op, carry, to) do {                                          \
+    unsigned short entry = shift_table[SHIFT_INDEX(op, carry, to)];        \
+    to = entry >> 8;                                                       \
+    flags = entry & 0xff;                                                  \
+    flags_lazy = LAZY_NONE;                                                \
 } while (0)
 
-#define SLA(to) do {           \
-    COND_FLAG(C, (to & 0x80)); \
-    to <<= 1;                  \
-    COND_FLAG(Z, (to == 0));   \
-    CLEAR_FLAG(N);             \
-    CLEAR_FLAG(H);             \
-} while (0)
-
-#define RRC(to) do {           \
-    COND_FLAG(C, (to & 0x1));  \
-    to = ROR(to);              \
-    COND_FLAG(Z, (to == 0));   \
-    CLEAR_FLAG(N);             \
-    CLEAR_FLAG(H);             \
-} while (0)
-
-#define RR(to) do {                \
-    char tmp = TEST_FLAG(C);       \
-    COND_FLAG(C, (to & 0x1));      \
-    to = ((to >> 1) | (tmp << 7)); \
-    COND_FLAG(Z, (to == 0));       \
-    CLEAR_FLAG(N);                 \
-    CLEAR_FLAG(H);                 \
-} while (0)
-
-#define SRA(to) do {              \
-    COND_FLAG(C, (to & 0x1));     \
-    to = (to >> 1) | (to & 0x80); \
-    COND_FLAG(Z, (to == 0));      \
-    CLEAR_FLAG(N);                \
-    CLEAR_FLAG(H);                \
-} while (0)
-
-#define SRL(to) do {              \
-    COND_FLAG(C, (to & 0x1));     \
-    to >>= 1;                     \
-    COND_FLAG(Z, (to == 0));      \
-    CLEAR_FLAG(N);                \
-    CLEAR_FLAG(H);                \
-} while (0)
+#define RLC(to) SHIFT(SHIFT_RLC, 0, to)
+#define RRC(to) SHIFT(SHIFT_RRC, 0, to)
+#define RL(to)  SHIFT(SHIFT_RL, TEST_FLAG(C), to)
+#define RR(to)  SHIFT(SHIFT_RR, TEST_FLAG(C), to)
+#define SLA(to) SHIFT(SHIFT_SLA, 0, to)
+#define SRA(to) SHIFT(SHIFT_SRA, 0, to)
+#define SRL(to) SHIFT(SHIFT_SRL, 0, to)
 
 #define INC16(to) SET_##to(GET_##to() + 1)
 #define DEC16(to) SET_##to(GET_##to() - 1)
 
-#define DEC(to) do {                             \
-    to--;                                        \
-    COND_FLAG(Z, (to == 0));                     \
-    SET_FLAG(N);                                 \
-    COND_FLAG(H, !HALFBORROW8((to + 1), 1, to)); \
+#define DEC(to) do {                                                       \
+    unsigned char carry = TEST_FLAG(C);                                    \
+    LAZY_ALU(LAZY_DEC, to, 1, carry, ((to - 1) & 0xff) | (carry << 8));    \
+    to = lazy_res;                                                         \
 } while (0)
 
-#define SWAP(reg8) do {                                \
-    reg8 = ((reg8 & 0xf) << 4) | ((reg8 & 0xf0) >> 4); \
-    COND_FLAG(Z, (reg8 == 0));                         \
-    CLEAR_FLAG(N);                                     \
-    CLEAR_FLAG(H);                                     \
-    CLEAR_FLAG(C);                                     \
-} while (0)
+#define SWAP(reg8) SHIFT(SHIFT_SWAP, 0, reg8)
 
 #define BIT(reg8, b) do {             \
     COND_FLAG(Z, !TEST_BIT(reg8, b)); \
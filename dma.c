@@ -0,0 +1,52 @@
+#include "common.h"
+#include "cpu.h"
+#include "mem.h"
+#include "dma.h"
+#include "sched.h"
+
+char dma_active;
+
+void map_all_pages ( void )
+{
+    unsigned int page;
+
+    for ( page = 0; page < 0x100; page++ )
+        map_page(page);
+}
+
+/* Copy page XX00 to OAM and lock the bus */
+void start_dma ( unsigned char page )
+{
+    unsigned short src;
+    char *from;
+    int i;
+
+    /* Sources above work RAM read its echo */
+    if ( page >= (RESERVED_AREA >> 8) )
+        page -= (RESERVED_AREA - INTERNAL_RAM) >> 8;
+    src = page << 8;
+
+    /* A DMA started during another one reads through the lockout */
+    if ( dma_active )
+    {
+        dma_active = 0;
+        map_all_pages();
+    }
+
+    if ( (from = read_page[page]) )
+        memcpy(mem_base + OBJECT_ATTRIBUTE, from, OAM_SIZE);
+    else
+        for ( i = 0; i < OAM_SIZE; i++ )
+            mem_base[OBJECT_ATTRIBUTE + i] = get_mem8(src + i);
+
+    dma_active = 1;
+    schedule(EVENT_DMA, total_cpu_cycles + DMA_CYCLES);
+    map_all_pages();
+}
+
+/* Release the bus once the transfer time is up */
+void dma_event ( unsigned int when )
+{
+    dma_active = 0;
+    map_all_pages();
+}
@@ -0,0 +1,16 @@
+void start_dma(unsigned char page);
+void dma_event(unsigned int when);
+
+/*
+ * OAM DMA.  The 160-byte copy to OAM is done in one go when DMA is
+ * written; what is modelled over time is the bus lockout that follows,
+ * during which the CPU can only reach the 0xff00 page.  It is a single
+ * EVENT_DMA deadline: the page table sends every other page down the slow
+ * path until it passes.
+ */
+
+#define OAM_SIZE   0xa0
+/* Hardware holds the bus for 160 machine cycles */
+#define DMA_CYCLES 640
+
+char dma_active;
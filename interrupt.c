@@ -1,52 +1,39 @@
 #include "common.h"
 #include "cpu.h"
 #include "mem.h"
+#include "io_regs.h"
 #include "interrupt.h"
 
+void set_IF ( unsigned char value )
+{
+    IO_REG(INTERRUPT_FLAG) = value;
+    irq_pending = value & IO_REG(INTERRUPT_ENABLE) & IRQ_MASK;
+}
+
+void set_IE ( unsigned char value )
+{
+    IO_REG(INTERRUPT_ENABLE) = value;
+    irq_pending = IO_REG(INTERRUPT_FLAG) & value & IRQ_MASK;
+}
+
 void check_interrupts ( void )
 {
-    /* Check if interrupts are disabled */
-    if ( ime == 0 )
+    unsigned int source;
+
+    /* Check if interrupts are disabled, or none are queued */
+    if ( ime == 0 || irq_pending == 0 )
         return;
 
-    /* Handle any queued interrupts */
-    if ( TEST_IF(V_BLANK) && TEST_IE(V_BLANK) )
-    {
-        CLEAR_IF(V_BLANK);
-        ime = 0;
-        CALL(V_BLANK_INT);
-        cpu_cycles = 16;
-    }
-    else if ( TEST_IF(LCD_STAT) && TEST_IE(LCD_STAT) )
-    {
-        CLEAR_IF(LCD_STAT);
-        ime = 0;
-        CALL(LCD_STAT_INT);
-        cpu_cycles = 16;
-    }
-    else if ( TEST_IF(TIMER) && TEST_IE(TIMER) )
-    {
-        CLEAR_IF(TIMER);
-        ime = 0;
-        CALL(TIMER_INT);
-        cpu_cycles = 16;
-    }
-    else if ( TEST_IF(SERIAL) && TEST_IE(SERIAL) )
-    {
-        CLEAR_IF(SERIAL);
-        ime = 0;
-        CALL(SERIAL_INT);
-        cpu_cycles = 16;
-    }
-    else if ( TEST_IF(JOYPAD) && TEST_IE(JOYPAD) )
-    {
-        CLEAR_IF(JOYPAD);
-        ime = 0;
-        CALL(JOYPAD_INT);
-        cpu_cycles = 16;
-    }
-
-    total_cpu_cycles += cpu_cycles;
+    /* The lowest numbered source has priority; vectors are 8 bytes apart */
+    source = __builtin_ctz(irq_pending);
+    set_IF(IO_REG(INTERRUPT_FLAG) & ~(1 << source));
+    ime = 0;
+    halt = 0;
+    CALL(V_BLANK_INT + source * 8);
+
+    /* Dispatch takes 16 cycles on top of the instruction just run */
+    cpu_cycles += 16;
+    total_cpu_cycles += 16;
 }
 
 void init_interrupt( void )
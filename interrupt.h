@@ -1,15 +1,24 @@
 void init_interrupt(void);
 void check_interrupts(void);
+void set_IF(unsigned char value);
+void set_IE(unsigned char value);
 
 char ime;
 
-#define TEST_IF(flag)  ((get_mem8(INTERRUPT_FLAG) & flag##_FLAG) >> flag##_SHIFT)
-#define SET_IF(flag)   set_mem8(INTERRUPT_FLAG, (get_mem8(INTERRUPT_FLAG) | flag##_FLAG))
-#define CLEAR_IF(flag) set_mem8(INTERRUPT_FLAG, (get_mem8(INTERRUPT_FLAG) & ~flag##_FLAG))
+/* IF & IE over the five sources.  IF and IE are raw bytes, but only ever
+ * changed through set_IF() and set_IE(), which keep this up to date, so
+ * testing for a pending interrupt is a single load. */
+unsigned char irq_pending;
 
-#define TEST_IE(flag)  ((get_mem8(INTERRUPT_ENABLE) & flag##_FLAG) >> flag##_SHIFT)
-#define SET_IE(flag)   set_mem8(INTERRUPT_ENABLE, (get_mem8(INTERRUPT_ENABLE) | flag##_FLAG))
-#define CLEAR_IE(flag) set_mem8(INTERRUPT_ENABLE, (get_mem8(INTERRUPT_ENABLE) & ~flag##_FLAG))
+#define IRQ_MASK 0x1f
+
+#define TEST_IF(flag)  ((IO_REG(INTERRUPT_FLAG) & flag##_FLAG) >> flag##_SHIFT)
+#define SET_IF(flag)   set_IF(IO_REG(INTERRUPT_FLAG) | flag##_FLAG)
+#define CLEAR_IF(flag) set_IF(IO_REG(INTERRUPT_FLAG) & ~flag##_FLAG)
+
+#define TEST_IE(flag)  ((IO_REG(INTERRUPT_ENABLE) & flag##_FLAG) >> flag##_SHIFT)
+#define SET_IE(flag)   set_IE(IO_REG(INTERRUPT_ENABLE) | flag##_FLAG)
+#define CLEAR_IE(flag) set_IE(IO_REG(INTERRUPT_ENABLE) & ~flag##_FLAG)
 
 #define INTERRUPT(flag) SET_IF(flag)
 
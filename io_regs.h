@@ -1,5 +1,18 @@
-int handle_ioregs_read(unsigned short addr, char *value);
-int handle_ioregs_write(unsigned short addr, char value);
+typedef void (*io_write_handler)(unsigned short addr, char value);
+typedef void (*io_read_handler)(unsigned short addr);
+
+/* Write handlers indexed by the low address byte; registers without one are
+ * plain bytes */
+extern const io_write_handler io_write[0x100];
+
+/* Read handlers bring registers that are computed from the cycle counter up
+ * to date before they are read */
+extern const io_read_handler io_read[0x100];
+
+/* Raw register byte.  The registers live in the I/O page of memory, one
+ * contiguous page-aligned block, so reads of registers without a read
+ * handler are plain loads. */
+#define IO_REG(addr) (((unsigned char *)mem_base)[addr])
 
 /*
  * GameBoy I/O Ports
@@ -15,6 +28,13 @@ int handle_ioregs_write(unsigned short addr, char value);
 /* LCD Status Register */
 #define STAT 0xff41
 
+#define STAT_MODE        0x03
+#define STAT_COINCIDENCE 0x04
+#define STAT_H_BLANK_INT 0x08
+#define STAT_V_BLANK_INT 0x10
+#define STAT_OAM_INT     0x20
+#define STAT_LYC_INT     0x40
+
 /* LCD Position and Scrolling */
 #define SCY  0xff42
 #define SCX  0xff43
@@ -67,6 +87,8 @@ int handle_ioregs_write(unsigned short addr, char value);
 #define NR51 0xff25
 #define NR52 0xff26
 
+#define NR52_POWER 0x80
+
 /*
  * Joypad Input
  */
@@ -89,6 +111,21 @@ int handle_ioregs_write(unsigned short addr, char value);
 #define TMA  0xff06
 #define TAC  0xff07
 
+/*
+ * Color GameBoy
+ */
+
+/* VRAM and WRAM Bank Select */
+#define VBK  0xff4f
+#define SVBK 0xff70
+
+/* VRAM DMA Transfers */
+#define HDMA1 0xff51
+#define HDMA2 0xff52
+#define HDMA3 0xff53
+#define HDMA4 0xff54
+#define HDMA5 0xff55
+
 /*
  * Boot ROM Disable
  */
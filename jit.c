@@ -0,0 +1,1312 @@
+#include <sys/mman.h>
+#include "common.h"
+#include "cpu.h"
+#include "mem.h"
+#include "trace.h"
+#include "tables.h"
+#include "jit.h"
+#include "block.h"
+#include "watch.h"
+
+char jit_enabled;
+char jit_verify;
+unsigned int jit_cycles;
+unsigned int jit_budget;
+
+#if defined(__x86_64__)
+
+/* Host registers; guest state is addressed off rbx, which holds &a */
+#define EAX 0
+#define ECX 1
+#define EDX 2
+#define RBX 3
+#define EDI 7
+
+/* Condition codes for jcc/setcc */
+#define CC_A  0x7
+#define CC_Z  0x4
+#define CC_NZ 0x5
+
+/* Displacement of a guest variable from the rbx base */
+#define VAR(v) ((int)((char *)&(v) - (char *)&a))
+
+/* Guest registers in opcode order; slot 6 is (HL) and is not translated */
+unsigned char *jit_regs[8] = { &b, &c, &d, &e, &h, &l, NULL, &a };
+
+unsigned char *jit_cache, *jit_ptr;
+struct jit_block *jit_pool;
+unsigned int jit_nblocks;
+struct jit_block *jit_hash[JIT_HASH_SIZE];
+unsigned int jit_generation;
+
+/* cycles_ahead stores in the block being translated, holding the block's
+ * cycles before the reading instruction until they are patched, and the pc
+ * stores before each read, patched with the address of the next instruction
+ * as the interpreter has it */
+unsigned char *jit_reads[JIT_MAX_OPS * 2];
+unsigned char *jit_read_pcs[JIT_MAX_OPS * 2];
+unsigned int jit_nreads;
+
+/* Cycle refunds in the side exits of the block's stores, holding the block's
+ * cycles before the storing instruction until they are patched with what
+ * it and the rest of the block would have taken */
+unsigned char *jit_stores[JIT_MAX_OPS];
+unsigned int jit_nstores;
+
+/* Exit taken by the last block run, to skip the lookup for its successor */
+struct jit_exit *jit_last;
+
+/* Translated blocks by start page, and how often each page has had a
+ * block overwritten under it since the last flush */
+struct jit_block *jit_pages[0x100];
+unsigned char jit_smc[0x100];
+
+/* Returned by blocks that were overwritten while chained to */
+struct jit_exit jit_dead_exit;
+
+/* Returned by a store that has to go through set_mem8(), with pc left at
+ * the storing instruction for the interpreter */
+struct jit_exit jit_side_exit;
+
+/* Pages stores can reach directly, before the block and after its native
+ * run, for the verifier */
+char jit_ram_before[0x10000], jit_ram_native[0x10000];
+
+/* Guest state snapshot for the verifier */
+struct jit_state
+{
+    unsigned char a, b, c, d, e, h, l, flags;
+    unsigned char flags_lazy, lazy_src, lazy_arg, lazy_carry;
+    unsigned short lazy_res, pc, sp;
+    unsigned int total_cpu_cycles;
+};
+
+#define JIT_MAX_BLOCKS (JIT_CACHE_SIZE / 256)
+
+void emit8 ( unsigned char byte )
+{
+    *jit_ptr++ = byte;
+}
+
+void emit16 ( unsigned short word )
+{
+    memcpy(jit_ptr, &word, 2);
+    jit_ptr += 2;
+}
+
+void emit32 ( unsigned int word )
+{
+    memcpy(jit_ptr, &word, 4);
+    jit_ptr += 4;
+}
+
+void emit64 ( unsigned long word )
+{
+    memcpy(jit_ptr, &word, 8);
+    jit_ptr += 8;
+}
+
+/* op reg, [rbx + disp32] */
+void emit_mem ( unsigned char op, int reg, int disp )
+{
+    emit8(op);
+    emit8(0x80 | (reg << 3) | RBX);
+    emit32(disp);
+}
+
+void emit_load8 ( int reg, int disp )
+{
+    emit8(0x0f);
+    emit_mem(0xb6, reg, disp);
+}
+
+void emit_load16 ( int reg, int disp )
+{
+    emit8(0x0f);
+    emit_mem(0xb7, reg, disp);
+}
+
+void emit_store8 ( int reg, int disp )
+{
+    emit_mem(0x88, reg, disp);
+}
+
+void emit_store16 ( int reg, int disp )
+{
+    emit8(0x66);
+    emit_mem(0x89, reg, disp);
+}
+
+void emit_store8_imm ( int disp, unsigned char imm )
+{
+    emit_mem(0xc6, 0, disp);
+    emit8(imm);
+}
+
+void emit_store16_imm ( int disp, unsigned short imm )
+{
+    emit8(0x66);
+    emit_mem(0xc7, 0, disp);
+    emit16(imm);
+}
+
+/* add [rbx + disp32], imm for a 2, 4 or 8 byte variable */
+void emit_add_mem ( int disp, int size, int imm )
+{
+    if ( size == 2 )
+    {
+        emit8(0x66);
+        emit_mem(0x81, 0, disp);
+        emit16(imm);
+        return;
+    }
+
+    if ( size == 8 )
+        emit8(0x48);
+    emit_mem(0x81, 0, disp);
+    emit32(imm);
+}
+
+/* Register to register ALU op (add 0x01, or 0x09, and 0x21, sub 0x29,
+ * xor 0x31, cmp 0x39, mov 0x89, test 0x85) */
+void emit_alu ( unsigned char op, int dst, int src )
+{
+    emit8(op);
+    emit8(0xc0 | (src << 3) | dst);
+}
+
+/* Group 1 op with an 8-bit immediate (add 0, or 1, and 4, sub 5) */
+void emit_alu_imm ( int ext, int reg, unsigned char imm )
+{
+    emit8(0x83);
+    emit8(0xc0 | (ext << 3) | reg);
+    emit8(imm);
+}
+
+void emit_shl ( int reg, unsigned char count )
+{
+    emit8(0xc1);
+    emit8(0xe0 | reg);
+    emit8(count);
+}
+
+void emit_shr ( int reg, unsigned char count )
+{
+    emit8(0xc1);
+    emit8(0xe8 | reg);
+    emit8(count);
+}
+
+/* Short forward branch; returns the displacement byte for patch8() */
+unsigned char *emit_jcc8 ( int cc )
+{
+    emit8(0x70 | cc);
+    emit8(0);
+    return jit_ptr - 1;
+}
+
+unsigned char *emit_jmp8 ( void )
+{
+    emit8(0xeb);
+    emit8(0);
+    return jit_ptr - 1;
+}
+
+void patch8 ( unsigned char *at )
+{
+    *at = jit_ptr - (at + 1);
+}
+
+/* Group 1 op with a 32-bit immediate */
+void emit_alu_imm32 ( int ext, int reg, unsigned int imm )
+{
+    emit8(0x81);
+    emit8(0xc0 | (ext << 3) | reg);
+    emit32(imm);
+}
+
+/* Group 1 op on a guest byte (or 1, and 4, xor 6) */
+void emit_mem_imm8 ( int ext, int disp, unsigned char imm )
+{
+    emit_mem(0x80, ext, disp);
+    emit8(imm);
+}
+
+void emit_mov_imm ( int reg, unsigned int imm )
+{
+    emit8(0xb8 | reg);
+    emit32(imm);
+}
+
+/* Call into C; rsp is 16-byte aligned after the prologue's push rbx, and
+ * only rbx needs to survive the call */
+void emit_call ( void *fn )
+{
+    emit8(0x48);                        /* movabs rax, fn */
+    emit8(0xb8);
+    emit64((unsigned long)fn);
+    emit8(0xff);                        /* call rax */
+    emit8(0xd0);
+}
+
+/* reg = (hi << 8) | lo, using EDX as scratch */
+void emit_pair ( int reg, unsigned char *hi, unsigned char *lo )
+{
+    emit_load8(reg, VAR(*hi));
+    emit_shl(reg, 8);
+    emit_load8(EDX, VAR(*lo));
+    emit_alu(0x09, reg, EDX);
+}
+
+/* eax = (unsigned char)get_mem8(edi).  cycles_ahead and pc, for watchpoint
+ * hooks, are patched once the instruction and block lengths are known. */
+void emit_read ( void )
+{
+    emit_store16_imm(VAR(pc), 0);
+    jit_read_pcs[jit_nreads] = jit_ptr - 2;
+    emit_mem(0xc7, 0, VAR(cycles_ahead));    /* mov dword [cycles_ahead], imm32 */
+    jit_reads[jit_nreads++] = jit_ptr;
+    emit32(0);
+    emit_call(get_mem8);
+    emit8(0x0f);                        /* movzx eax, al */
+    emit8(0xb6);
+    emit8(0xc0);
+}
+
+/* set_mem8(edi, cl) for the instruction at addr when the page is plain
+ * memory.  Anything else (I/O, code, watched or battery RAM, DMA) leaves
+ * through a side exit that refunds the cycles the rest of the block charged
+ * and hands the instruction back to the interpreter. */
+void emit_write ( unsigned short addr )
+{
+    unsigned char *plain;
+
+    emit_alu(0x89, EAX, EDI);
+    emit_shr(EAX, 8);
+    emit8(0x48);                        /* mov rax, [rbx + rax*8 + disp32] */
+    emit8(0x8b);
+    emit8(0x84);
+    emit8(0xc3);
+    emit32(VAR(write_page));
+    emit8(0x48);                        /* test rax, rax */
+    emit8(0x85);
+    emit8(0xc0);
+    plain = emit_jcc8(CC_NZ);
+
+    emit_mov_imm(EAX, 0);
+    jit_stores[jit_nstores++] = jit_ptr - 4;
+    emit_mem(0x29, EAX, VAR(jit_cycles));   /* sub [jit_cycles], eax */
+    if ( sizeof(total_cpu_cycles) == 8 )
+        emit8(0x48);
+    emit_mem(0x29, EAX, VAR(total_cpu_cycles));
+    emit_store16_imm(VAR(pc), addr);
+    emit8(0x48);                        /* movabs rax, &jit_side_exit */
+    emit8(0xb8);
+    emit64((unsigned long)&jit_side_exit);
+    emit8(0x5b);                        /* pop rbx */
+    emit8(0xc3);                        /* ret */
+
+    patch8(plain);
+    emit_alu_imm32(4, EDI, 0xff);
+    emit8(0x88);                        /* mov [rax + rdi], cl */
+    emit8(0x0c);
+    emit8(0x38);
+}
+
+/* SYNC_FLAGS() */
+void emit_sync ( void )
+{
+    unsigned char *synced;
+
+    emit_load8(EAX, VAR(flags_lazy));
+    emit_alu(0x85, EAX, EAX);
+    synced = emit_jcc8(CC_Z);
+    emit_call(sync_flags);
+    patch8(synced);
+}
+
+/* eax = table[ecx] for a table of unsigned shorts */
+void emit_table16 ( const unsigned short *table )
+{
+    emit8(0x0f);                        /* movzx eax, word [rbx + rcx*2 + disp32] */
+    emit8(0xb7);
+    emit8(0x84);
+    emit8(0x4b);
+    emit32(VAR(*table));
+}
+
+/* reg = TEST_FLAG(C) */
+void emit_test_c ( int reg )
+{
+    unsigned char *materialized, *done;
+
+    emit_load8(reg, VAR(flags_lazy));
+    emit_alu(0x85, reg, reg);
+    materialized = emit_jcc8(CC_Z);
+    emit_load16(reg, VAR(lazy_res));
+    emit_shr(reg, 8);
+    emit_alu_imm(4, reg, 1);
+    done = emit_jmp8();
+    patch8(materialized);
+    emit_load8(reg, VAR(flags));
+    emit_shr(reg, C_SHIFT);
+    emit_alu_imm(4, reg, 1);
+    patch8(done);
+}
+
+/* reg = TEST_FLAG(Z) */
+void emit_test_z ( int reg )
+{
+    unsigned char *materialized, *done;
+
+    emit_load8(reg, VAR(flags_lazy));
+    emit_alu(0x85, reg, reg);
+    materialized = emit_jcc8(CC_Z);
+    emit_load16(reg, VAR(lazy_res));
+    emit8(0x84);                        /* test r8, r8 */
+    emit8(0xc0 | (reg << 3) | reg);
+    emit8(0x0f);                        /* sete r8 */
+    emit8(0x90 | CC_Z);
+    emit8(0xc0 | reg);
+    emit8(0x0f);                        /* movzx r32, r8 */
+    emit8(0xb6);
+    emit8(0xc0 | (reg << 3) | reg);
+    done = emit_jmp8();
+    patch8(materialized);
+    emit_load8(reg, VAR(flags));
+    emit_shr(reg, Z_SHIFT);
+    patch8(done);
+}
+
+/* Leave the block for target: chain straight into the next block if it
+ * fits in the budget, otherwise store pc and return the exit to jit_exec() */
+void emit_exit ( struct jit_block *block, int n, unsigned short target )
+{
+    struct jit_exit *exit = &block->exits[n];
+    unsigned char *over_budget;
+
+    exit->target = target;
+    exit->from = block;
+
+    emit_mem(0x8b, EAX, VAR(jit_cycles));
+    emit_alu_imm32(0, EAX, 0);          /* + cycles of the chained block */
+    exit->cycles = jit_ptr - 4;
+    emit_mem(0x3b, EAX, VAR(jit_budget));
+    over_budget = emit_jcc8(CC_A);
+    emit8(0xe9);                        /* jmp rel32, falls through until chained */
+    exit->patch = jit_ptr;
+    emit32(0);
+    patch8(over_budget);
+    emit_store16_imm(VAR(pc), target);
+    emit8(0x48);                        /* movabs rax, exit */
+    emit8(0xb8);
+    emit64((unsigned long)exit);
+    emit8(0x5b);                        /* pop rbx */
+    emit8(0xc3);                        /* ret */
+}
+
+/* Load guest register, (HL) or immediate operand into ECX */
+void emit_operand ( unsigned char op, unsigned short addr )
+{
+    if ( op >= 0xc0 )
+        emit_mov_imm(ECX, (unsigned char)peek_mem8(addr + 1));
+    else if ( (op & 7) == 6 )
+    {
+        emit_pair(EDI, &h, &l);
+        emit_read();
+        emit_alu(0x89, ECX, EAX);
+    }
+    else
+        emit_load8(ECX, VAR(*jit_regs[op & 7]));
+}
+
+/* ADD/ADC/SUB/SBC/CP: a (op) ecx, leaving the lazy flag state behind */
+void emit_arith ( int kind, int with_carry, int store )
+{
+    emit_load8(EAX, VAR(a));
+    if ( with_carry )
+        emit_test_c(EDX);
+    else
+        emit_alu(0x31, EDX, EDX);
+    emit_store8(EAX, VAR(lazy_src));
+    emit_store8(ECX, VAR(lazy_arg));
+    emit_store8(EDX, VAR(lazy_carry));
+    emit_alu(kind == LAZY_ADD ? 0x01 : 0x29, EAX, ECX);
+    emit_alu(kind == LAZY_ADD ? 0x01 : 0x29, EAX, EDX);
+    emit_store16(EAX, VAR(lazy_res));
+    emit_store8_imm(VAR(flags_lazy), kind);
+    if ( store )
+        emit_store8(EAX, VAR(a));
+}
+
+/* AND/XOR/OR: a (op) ecx, flags materialized directly */
+void emit_bitwise ( unsigned char op, int hf )
+{
+    emit_load8(EAX, VAR(a));
+    emit_alu(op, EAX, ECX);
+    emit_store8(EAX, VAR(a));
+    emit_alu(0x31, EDX, EDX);
+    emit_alu(0x85, EAX, EAX);
+    emit8(0x0f);                        /* sete dl */
+    emit8(0x90 | CC_Z);
+    emit8(0xc0 | EDX);
+    emit_shl(EDX, Z_SHIFT);
+    if ( hf )
+        emit_alu_imm(1, EDX, H_FLAG);
+    emit_store8(EDX, VAR(flags));
+    emit_store8_imm(VAR(flags_lazy), LAZY_NONE);
+}
+
+/* INC r/DEC r: old carry rides along in bit 8 of lazy_res */
+void emit_incdec ( unsigned char *reg, int kind )
+{
+    emit_load8(EAX, VAR(*reg));
+    emit_test_c(EDX);
+    emit_store8(EAX, VAR(lazy_src));
+    emit_store8_imm(VAR(lazy_arg), 1);
+    emit_store8(EDX, VAR(lazy_carry));
+    emit_alu_imm(kind == LAZY_INC ? 0 : 5, EAX, 1);
+    emit8(0x0f);                        /* movzx eax, al */
+    emit8(0xb6);
+    emit8(0xc0);
+    emit_shl(EDX, 8);
+    emit_alu(0x09, EAX, EDX);
+    emit_store16(EAX, VAR(lazy_res));
+    emit_store8_imm(VAR(flags_lazy), kind);
+    emit_store8(EAX, VAR(*reg));
+}
+
+/* INC rr/DEC rr on a register pair */
+void emit_incdec16 ( unsigned char *hi, unsigned char *lo, int delta )
+{
+    emit_load8(EAX, VAR(*hi));
+    emit_shl(EAX, 8);
+    emit_load8(ECX, VAR(*lo));
+    emit_alu(0x09, EAX, ECX);
+    emit_alu_imm(delta > 0 ? 0 : 5, EAX, 1);
+    emit_store8(EAX, VAR(*lo));
+    emit_shr(EAX, 8);
+    emit_store8(EAX, VAR(*hi));
+}
+
+/* Rotate, shift or SWAP a register through shift_table */
+void emit_shift ( int kind, unsigned char *reg )
+{
+    if ( kind == SHIFT_RL || kind == SHIFT_RR )
+    {
+        emit_test_c(EDX);
+        emit_shl(EDX, 8);
+    }
+    else
+        emit_alu(0x31, EDX, EDX);
+    emit_load8(ECX, VAR(*reg));
+    emit_alu(0x09, ECX, EDX);
+    emit_alu_imm32(1, ECX, kind << 9);
+    emit_table16(shift_table);
+    emit_store8(EAX, VAR(flags));
+    emit_shr(EAX, 8);
+    emit_store8(EAX, VAR(*reg));
+    emit_store8_imm(VAR(flags_lazy), LAZY_NONE);
+}
+
+/* BIT n of eax, flags already synced: Z from the bit, N clear, H set */
+void emit_bit ( int bit )
+{
+    emit_alu(0x89, ECX, EAX);
+    emit_shr(ECX, bit);
+    emit_alu_imm(4, ECX, 1);
+    emit_alu_imm(6, ECX, 1);
+    emit_shl(ECX, Z_SHIFT);
+    emit_load8(EAX, VAR(flags));
+    emit_alu_imm(4, EAX, C_FLAG);
+    emit_alu_imm(1, EAX, H_FLAG);
+    emit_alu(0x09, EAX, ECX);
+    emit_store8(EAX, VAR(flags));
+}
+
+/* Conditional branch on Z or C; exit 0 is taken, exit 1 falls through.
+ * The block is charged the cost of falling through, so the taken side adds
+ * the difference. */
+void emit_branch ( struct jit_block *block, unsigned char op,
+                   unsigned short taken, unsigned short fallthrough, int extra )
+{
+    unsigned char *skip;
+
+    if ( op & 0x10 )
+        emit_test_c(EAX);
+    else
+        emit_test_z(EAX);
+    emit_alu(0x85, EAX, EAX);
+    skip = emit_jcc8((op & 0x08) ? CC_Z : CC_NZ);
+    emit_add_mem(VAR(jit_cycles), 4, extra);
+    emit_add_mem(VAR(total_cpu_cycles), sizeof(total_cpu_cycles), extra);
+    emit_exit(block, 0, taken);
+    patch8(skip);
+    emit_exit(block, 1, fallthrough);
+}
+
+/* CB-prefixed ops; everything but the (HL) writes */
+int jit_translate_cb ( unsigned char op )
+{
+    unsigned char reg = op & 7, bit = (op >> 3) & 7;
+
+    if ( op < 0x40 )
+    {
+        if ( reg == 6 )
+            return 0;
+        emit_shift(bit, jit_regs[reg]);
+        return 8;
+    }
+
+    if ( op < 0x80 )
+    {
+        emit_sync();
+        if ( reg == 6 )
+        {
+            emit_pair(EDI, &h, &l);
+            emit_read();
+        }
+        else
+            emit_load8(EAX, VAR(*jit_regs[reg]));
+        emit_bit(bit);
+        return 8;
+    }
+
+    if ( reg == 6 )
+        return 0;
+
+    if ( op < 0xc0 )
+        emit_mem_imm8(4, VAR(*jit_regs[reg]), ~(1 << bit));
+    else
+        emit_mem_imm8(1, VAR(*jit_regs[reg]), 1 << bit);
+    return 8;
+}
+
+/*
+ * Translate the instruction at *addr.  Returns its cycle count, 0 if it has
+ * to be interpreted, or -cycles if it ended the block.
+ */
+int jit_translate ( struct jit_block *block, unsigned short *addr )
+{
+    unsigned short at = *addr;
+    unsigned char op = peek_mem8(at);
+    unsigned char n = peek_mem8(at + 1);
+    unsigned short nn = n | ((unsigned char)peek_mem8(at + 2) << 8);
+    unsigned char dst = (op >> 3) & 7, src = op & 7;
+    int cycles;
+
+    if ( op == 0x00 )
+    {
+        *addr = at + 1;
+        return 4;
+    }
+
+    /* LD r, r' and LD r, (HL) */
+    if ( op >= 0x40 && op < 0x80 && dst != 6 )
+    {
+        if ( src == 6 )
+        {
+            emit_pair(EDI, &h, &l);
+            emit_read();
+            emit_store8(EAX, VAR(*jit_regs[dst]));
+        }
+        else if ( dst != src )
+        {
+            emit_load8(EAX, VAR(*jit_regs[src]));
+            emit_store8(EAX, VAR(*jit_regs[dst]));
+        }
+        *addr = at + 1;
+        return src == 6 ? 8 : 4;
+    }
+
+    /* ALU A, r, ALU A, (HL) and ALU A, n */
+    if ( (op >= 0x80 && op < 0xc0) || (op >= 0xc0 && src == 6 && op != 0xde) )
+    {
+        emit_operand(op, at);
+        switch ( dst )
+        {
+            case 0: emit_arith(LAZY_ADD, 0, 1); break;
+            case 1: emit_arith(LAZY_ADD, 1, 1); break;
+            case 2: emit_arith(LAZY_SUB, 0, 1); break;
+            case 3: emit_arith(LAZY_SUB, 1, 1); break;
+            case 4: emit_bitwise(0x21, 1); break;
+            case 5: emit_bitwise(0x31, 0); break;
+            case 6: emit_bitwise(0x09, 0); break;
+            case 7: emit_arith(LAZY_SUB, 0, 0); break;
+        }
+        *addr = at + (op >= 0xc0 ? 2 : 1);
+        return (op >= 0xc0 || src == 6) ? 8 : 4;
+    }
+
+    if ( op < 0x40 && dst != 6 )
+    {
+        switch ( src )
+        {
+            case 4: /* INC r */
+                emit_incdec(jit_regs[dst], LAZY_INC);
+                *addr = at + 1;
+                return 4;
+
+            case 5: /* DEC r */
+                emit_incdec(jit_regs[dst], LAZY_DEC);
+                *addr = at + 1;
+                return 4;
+
+            case 6: /* LD r, n */
+                emit_store8_imm(VAR(*jit_regs[dst]), n);
+                *addr = at + 2;
+                return 8;
+        }
+    }
+
+    switch ( op )
+    {
+        case 0x01: case 0x11: case 0x21: /* LD rr, nn */
+            emit_store8_imm(VAR(*jit_regs[dst]), nn >> 8);
+            emit_store8_imm(VAR(*jit_regs[dst + 1]), nn & 0xff);
+            *addr = at + 3;
+            return 12;
+
+        case 0x31: /* LD SP, nn */
+            emit_store16_imm(VAR(sp), nn);
+            *addr = at + 3;
+            return 12;
+
+        case 0x03: case 0x13: case 0x23: /* INC rr */
+            emit_incdec16(jit_regs[dst], jit_regs[dst + 1], 1);
+            *addr = at + 1;
+            return 8;
+
+        case 0x0b: case 0x1b: case 0x2b: /* DEC rr */
+            emit_incdec16(jit_regs[dst - 1], jit_regs[dst], -1);
+            *addr = at + 1;
+            return 8;
+
+        case 0x33: /* INC SP */
+            emit_add_mem(VAR(sp), 2, 1);
+            *addr = at + 1;
+            return 8;
+
+        case 0x3b: /* DEC SP */
+            emit_add_mem(VAR(sp), 2, 0xffff);
+            *addr = at + 1;
+            return 8;
+
+        case 0x09: case 0x19: case 0x29: case 0x39: /* ADD HL, rr */
+            emit_sync();
+            if ( op == 0x39 )
+                emit_load16(ECX, VAR(sp));
+            else
+                emit_pair(ECX, jit_regs[dst - 1], jit_regs[dst]);
+            emit_pair(EAX, &h, &l);
+            emit_alu(0x01, EAX, ECX);
+            emit_store8(EAX, VAR(l));
+            emit_shr(EAX, 8);
+            emit_store8(EAX, VAR(h));
+            emit_shr(EAX, 8);
+            emit_shl(EAX, C_SHIFT);
+            emit_load8(ECX, VAR(flags));
+            emit_alu_imm(4, ECX, Z_FLAG);
+            emit_alu(0x09, ECX, EAX);
+            emit_store8(ECX, VAR(flags));
+            *addr = at + 1;
+            return 8;
+
+        case 0x07: case 0x0f: case 0x17: case 0x1f: /* RLCA, RRCA, RLA, RRA */
+            emit_shift(dst, &a);
+            emit_mem_imm8(4, VAR(flags), C_FLAG);
+            *addr = at + 1;
+            return 4;
+
+        case 0x27: /* DAA */
+            emit_sync();
+            emit_load8(ECX, VAR(flags));
+            emit_alu_imm(4, ECX, 0x70);
+            emit_shl(ECX, 4);
+            emit_load8(EDX, VAR(a));
+            emit_alu(0x09, ECX, EDX);
+            emit_table16(daa_table);
+            emit_store8(EAX, VAR(flags));
+            emit_shr(EAX, 8);
+            emit_store8(EAX, VAR(a));
+            *addr = at + 1;
+            return 4;
+
+        case 0x2f: /* CPL */
+            emit_mem_imm8(6, VAR(a), 0xff);
+            emit_sync();
+            emit_mem_imm8(1, VAR(flags), N_FLAG | H_FLAG);
+            *addr = at + 1;
+            return 4;
+
+        case 0x37: /* SCF */
+            emit_sync();
+            emit_mem_imm8(4, VAR(flags), Z_FLAG);
+            emit_mem_imm8(1, VAR(flags), C_FLAG);
+            *addr = at + 1;
+            return 4;
+
+        case 0x3f: /* CCF */
+            emit_sync();
+            emit_mem_imm8(4, VAR(flags), Z_FLAG | C_FLAG);
+            emit_mem_imm8(6, VAR(flags), C_FLAG);
+            *addr = at + 1;
+            return 4;
+
+        case 0x0a: case 0x1a: /* LD A, (BC) and LD A, (DE) */
+            emit_pair(EDI, jit_regs[dst - 1], jit_regs[dst]);
+            emit_read();
+            emit_store8(EAX, VAR(a));
+            *addr = at + 1;
+            return 8;
+
+        case 0x2a: case 0x3a: /* LD A, (HL+) and LD A, (HL-) */
+            emit_pair(EDI, &h, &l);
+            emit_read();
+            emit_store8(EAX, VAR(a));
+            emit_incdec16(&h, &l, op == 0x2a ? 1 : -1);
+            *addr = at + 1;
+            return 8;
+
+        case 0xfa: /* LD A, (nn) */
+            emit_mov_imm(EDI, nn);
+            emit_read();
+            emit_store8(EAX, VAR(a));
+            *addr = at + 3;
+            return 16;
+
+        case 0xf0: /* LDH A, (n) */
+            emit_mov_imm(EDI, 0xff00 | n);
+            emit_read();
+            emit_store8(EAX, VAR(a));
+            *addr = at + 2;
+            return 12;
+
+        case 0xf2: /* LD A, (C) */
+            emit_load8(EDI, VAR(c));
+            emit_alu_imm32(1, EDI, 0xff00);
+            emit_read();
+            emit_store8(EAX, VAR(a));
+            *addr = at + 1;
+            return 8;
+
+        case 0x02: case 0x12: /* LD (BC), A and LD (DE), A */
+            emit_pair(EDI, jit_regs[dst], jit_regs[dst + 1]);
+            emit_load8(ECX, VAR(a));
+            emit_write(at);
+            *addr = at + 1;
+            return 8;
+
+        case 0x22: case 0x32: /* LD (HL+), A and LD (HL-), A */
+            emit_pair(EDI, &h, &l);
+            emit_load8(ECX, VAR(a));
+            emit_write(at);
+            emit_incdec16(&h, &l, op == 0x22 ? 1 : -1);
+            *addr = at + 1;
+            return 8;
+
+        case 0x70: case 0x71: case 0x72: case 0x73: /* LD (HL), r */
+        case 0x74: case 0x75: case 0x77:
+            emit_pair(EDI, &h, &l);
+            emit_load8(ECX, VAR(*jit_regs[src]));
+            emit_write(at);
+            *addr = at + 1;
+            return 8;
+
+        case 0x36: /* LD (HL), n */
+            emit_pair(EDI, &h, &l);
+            emit_mov_imm(ECX, n);
+            emit_write(at);
+            *addr = at + 2;
+            return 12;
+
+        case 0xf9: /* LD SP, HL */
+            emit_pair(EAX, &h, &l);
+            emit_store16(EAX, VAR(sp));
+            *addr = at + 1;
+            return 8;
+
+        case 0xcb:
+            if ( (cycles = jit_translate_cb(n)) )
+                *addr = at + 2;
+            return cycles;
+
+        case 0x18: /* JR n */
+            emit_exit(block, 0, at + 2 + (signed char)n);
+            *addr = at + 2;
+            return -12;
+
+        case 0x20: case 0x28: case 0x30: case 0x38: /* JR cc, n */
+            emit_branch(block, op, at + 2 + (signed char)n, at + 2, 4);
+            *addr = at + 2;
+            return -8;
+
+        case 0xc3: /* JP nn */
+            emit_exit(block, 0, nn);
+            *addr = at + 3;
+            return -16;
+
+        case 0xc2: case 0xca: case 0xd2: case 0xda: /* JP cc, nn */
+            emit_branch(block, op, nn, at + 3, 4);
+            *addr = at + 3;
+            return -12;
+    }
+
+    return 0;
+}
+
+unsigned int jit_key ( unsigned short addr )
+{
+    return (code_bank(addr) << 16) | addr;
+}
+
+void jit_flush ( void )
+{
+    jit_ptr = jit_cache;
+    jit_nblocks = 0;
+    jit_generation++;
+    jit_last = NULL;
+    memset(jit_hash, 0, sizeof(jit_hash));
+    memset(jit_pages, 0, sizeof(jit_pages));
+    memset(jit_smc, 0, sizeof(jit_smc));
+    unmark_code_pages(CODE_JIT);
+}
+
+/* Translate the block at addr.  A block with no instructions marks code
+ * that is always left to the interpreter. */
+struct jit_block *jit_compile ( unsigned short addr )
+{
+    struct jit_block *block;
+    unsigned char *add_cycles, *add_total;
+    unsigned short at = addr;
+    int region = code_region(addr);
+    int cycles = 0;
+    unsigned int page, i, reads, stores, ahead;
+
+    if ( jit_nblocks == JIT_MAX_BLOCKS || jit_ptr + JIT_BLOCK_SIZE > jit_cache + JIT_CACHE_SIZE )
+        jit_flush();
+
+    block = &jit_pool[jit_nblocks++];
+    memset(block, 0, sizeof(*block));
+    block->key = jit_key(addr);
+    block->start = addr;
+    block->code = jit_ptr;
+
+    emit8(0x53);                        /* push rbx */
+    emit8(0x48);                        /* movabs rbx, &a */
+    emit8(0xbb);
+    emit64((unsigned long)&a);
+
+    /* Cycles are only known once the block is done, so patch them in */
+    block->body = jit_ptr;
+    emit_add_mem(VAR(jit_cycles), 4, 0);
+    add_cycles = jit_ptr - 4;
+    emit_add_mem(VAR(total_cpu_cycles), sizeof(total_cpu_cycles), 0);
+    add_total = jit_ptr - 4;
+    jit_nreads = 0;
+    jit_nstores = 0;
+
+    if ( region >= 0 && jit_smc[addr >> 8] < JIT_SMC_LIMIT )
+    {
+        while ( block->count < JIT_MAX_OPS && code_region(at) == region && !break_pages[at >> 8] )
+        {
+            /* Never fetch operands from past the end of the region */
+            if ( code_region(at + op_info[(unsigned char)peek_mem8(at)].length - 1) != region )
+                break;
+
+            reads = jit_nreads;
+            stores = jit_nstores;
+            if ( (cycles = jit_translate(block, &at)) == 0 )
+                break;
+
+            for ( i = reads; i < jit_nreads; i++ )
+            {
+                memcpy(jit_reads[i], &block->cycles, 4);
+                memcpy(jit_read_pcs[i], &at, 2);
+            }
+            for ( i = stores; i < jit_nstores; i++ )
+                memcpy(jit_stores[i], &block->cycles, 4);
+
+            block->count++;
+            if ( cycles < 0 )
+            {
+                /* A block that stores nothing and jumps back to itself is a
+                 * candidate idle loop */
+                block->cycles -= cycles;
+                block->loop = jit_nstores == 0 && block->exits[0].target == addr;
+                break;
+            }
+            block->cycles += cycles;
+        }
+
+        if ( cycles >= 0 && block->count )
+            emit_exit(block, 0, at);
+    }
+
+    block->end = at;
+    block->stores = jit_nstores;
+
+    if ( block->count == 0 )
+    {
+        jit_ptr = block->code;
+        block->code = block->body = NULL;
+    }
+    else
+    {
+        memcpy(add_cycles, &block->cycles, 4);
+        memcpy(add_total, &block->cycles, 4);
+
+        /* A read sees the time its instruction starts, and a store's side
+         * exit takes back the cycles from its instruction on */
+        for ( i = 0; i < jit_nreads; i++ )
+        {
+            memcpy(&ahead, jit_reads[i], 4);
+            ahead = block->cycles - ahead;
+            memcpy(jit_reads[i], &ahead, 4);
+        }
+        for ( i = 0; i < jit_nstores; i++ )
+        {
+            memcpy(&ahead, jit_stores[i], 4);
+            ahead = block->cycles - ahead;
+            memcpy(jit_stores[i], &ahead, 4);
+        }
+    }
+
+    /* Writes to memory holding translated code go through jit_invalidate() */
+    if ( block->count )
+    {
+        for ( page = addr >> 8; page <= (unsigned short)(at - 1) >> 8; page++ )
+            mark_code_page(page, CODE_JIT);
+        block->page_next = jit_pages[addr >> 8];
+        jit_pages[addr >> 8] = block;
+    }
+
+    block->next = jit_hash[block->key & (JIT_HASH_SIZE - 1)];
+    jit_hash[block->key & (JIT_HASH_SIZE - 1)] = block;
+
+    return block;
+}
+
+struct jit_block *jit_lookup ( unsigned short addr )
+{
+    unsigned int key = jit_key(addr);
+    struct jit_block *block;
+
+    for ( block = jit_hash[key & (JIT_HASH_SIZE - 1)]; block; block = block->next )
+        if ( block->key == key )
+            return block;
+
+    return jit_compile(addr);
+}
+
+/* Link an exit straight to its successor.  A block may only jump into a
+ * switchable bank from the same bank, since the mapping can change between
+ * runs of the source block. */
+void jit_chain ( struct jit_exit *exit )
+{
+    unsigned int generation = jit_generation;
+    struct jit_block *next;
+    int rel;
+
+    jit_last = NULL;
+
+    if ( exit == &jit_dead_exit || exit == &jit_side_exit )
+        return;
+
+    if ( !exit->next || exit->next->key == JIT_DEAD )
+    {
+        if ( code_switchable(exit->target) &&
+             code_region(exit->target) != code_region(exit->from->start) )
+            return;
+
+        next = jit_lookup(exit->target);
+        if ( jit_generation != generation )
+            return;
+
+        /* Successors left to the interpreter are remembered but not linked,
+         * and loops are only entered through jit_exec() so idle ones can be
+         * skipped */
+        if ( next->count && (!next->loop || next == exit->from) )
+        {
+            rel = next->body - (exit->patch + 4);
+            memcpy(exit->patch, &rel, 4);
+            memcpy(exit->cycles, &next->cycles, 4);
+        }
+        exit->next = next;
+    }
+
+    jit_last = exit;
+}
+
+void jit_save ( struct jit_state *s )
+{
+    s->a = a; s->b = b; s->c = c; s->d = d; s->e = e; s->h = h; s->l = l;
+    s->flags = flags;
+    s->flags_lazy = flags_lazy;
+    s->lazy_src = lazy_src;
+    s->lazy_arg = lazy_arg;
+    s->lazy_carry = lazy_carry;
+    s->lazy_res = lazy_res;
+    s->pc = pc;
+    s->sp = sp;
+    s->total_cpu_cycles = total_cpu_cycles;
+}
+
+void jit_load ( struct jit_state *s )
+{
+    a = s->a; b = s->b; c = s->c; d = s->d; e = s->e; h = s->h; l = s->l;
+    flags = s->flags;
+    flags_lazy = s->flags_lazy;
+    lazy_src = s->lazy_src;
+    lazy_arg = s->lazy_arg;
+    lazy_carry = s->lazy_carry;
+    lazy_res = s->lazy_res;
+    pc = s->pc;
+    sp = s->sp;
+    total_cpu_cycles = s->total_cpu_cycles;
+}
+
+/* Copy the pages stores can reach without set_mem8() to or from copy */
+void jit_save_ram ( char *copy )
+{
+    unsigned int page;
+
+    for ( page = 0; page < 0x100; page++ )
+        if ( write_page[page] )
+            memcpy(copy + (page << 8), write_page[page], 0x100);
+}
+
+void jit_load_ram ( char *copy )
+{
+    unsigned int page;
+
+    for ( page = 0; page < 0x100; page++ )
+        if ( write_page[page] )
+            memcpy(write_page[page], copy + (page << 8), 0x100);
+}
+
+/* Replay the block just run on the interpreter and report any difference.
+ * Memory the block stored to is put back first, so the replay reads what
+ * the native run did, and a side exit is replayed up to its store. */
+void jit_check ( struct jit_block *block, struct jit_state *before, int side )
+{
+    struct jit_state native;
+    unsigned int i, page;
+
+    SYNC_FLAGS();
+    jit_save(&native);
+    jit_load(before);
+    if ( block->stores )
+    {
+        jit_save_ram(jit_ram_native);
+        jit_load_ram(jit_ram_before);
+    }
+
+    for ( i = 0; i < block->count && !(side && pc == native.pc); i++ )
+        exec_instruction();
+    SYNC_FLAGS();
+
+    if ( block->stores )
+        for ( page = 0; page < 0x100; page++ )
+            if ( write_page[page] && memcmp(write_page[page], jit_ram_native + (page << 8), 0x100) )
+                fprintf(stderr, "JIT store mismatch in block 0x%04hx-0x%04hx, page 0x%02x\n",
+                        block->start, block->end, page);
+
+    if ( native.a != a || native.b != b || native.c != c || native.d != d ||
+         native.e != e || native.h != h || native.l != l ||
+         native.flags != flags || native.pc != pc || native.sp != sp ||
+         native.total_cpu_cycles != total_cpu_cycles )
+    {
+        fprintf(stderr, "JIT mismatch in block 0x%04hx-0x%04hx\n", block->start, block->end);
+        fprintf(stderr, "  jit:    AF=%02hhx%02hhx BC=%02hhx%02hhx DE=%02hhx%02hhx HL=%02hhx%02hhx SP=%04hx PC=%04hx cycles=%u\n",
+                native.a, native.flags, native.b, native.c, native.d, native.e,
+                native.h, native.l, native.sp, native.pc, native.total_cpu_cycles);
+        fprintf(stderr, "  interp: AF=%02hhx%02hhx BC=%02hhx%02hhx DE=%02hhx%02hhx HL=%02hhx%02hhx SP=%04hx PC=%04hx cycles=%u\n",
+                a, flags, b, c, d, e, h, l, sp, pc, total_cpu_cycles);
+    }
+}
+
+/*
+ * Run a loop block an iteration at a time, as block_exec() does, since the
+ * first pass after an event may still see the input the event changed.  An
+ * iteration that changes nothing is polling, so the rest of the budget is
+ * skipped as in the block cache; otherwise the loop runs on through its
+ * self-linked exit.
+ */
+struct jit_exit *jit_loop ( struct jit_block *block, unsigned int budget )
+{
+    struct jit_exit *exit;
+    struct block_state before, after;
+    unsigned int start, tries;
+
+    /* A loop found busy is left running for a while before the next check */
+    if ( block->busy )
+    {
+        block->busy--;
+        jit_budget = budget;
+        exit = ((struct jit_exit *(*)(void))block->code)();
+        cycles_ahead = 0;
+        return exit;
+    }
+
+    for ( tries = 0; tries < JIT_LOOP_TRIES; tries++ )
+    {
+        block_save(&before);
+        timed_read = 0;
+        start = jit_cycles;
+        jit_budget = 0;
+        exit = ((struct jit_exit *(*)(void))block->code)();
+        cycles_ahead = 0;
+
+        if ( pc != block->start )
+            return exit;
+
+        block_save(&after);
+        if ( memcmp(&before, &after, sizeof(before)) == 0 )
+        {
+            if ( jit_cycles < budget )
+                jit_cycles += idle_skip(budget - jit_cycles, jit_cycles - start);
+            return exit;
+        }
+
+        if ( jit_cycles + jit_cycles - start > budget )
+            return exit;
+    }
+
+    block->busy = JIT_LOOP_BACKOFF;
+    jit_chain(exit);
+    jit_budget = budget;
+    exit = ((struct jit_exit *(*)(void))block->code)();
+    cycles_ahead = 0;
+    return exit;
+}
+
+/*
+ * Run translated code at pc, chaining from block to block for as long as
+ * the next block still completes within budget cycles.  The caller passes
+ * the cycles left until the next hardware event, so interrupts are taken
+ * on the same instruction as in the interpreter.  Returns 0 when pc has to
+ * be interpreted instead.
+ */
+int jit_exec ( unsigned int budget )
+{
+    struct jit_block *block;
+    struct jit_exit *exit;
+    struct jit_state before;
+
+    if ( !jit_enabled || trace_enabled )
+        return 0;
+
+    if ( jit_last && jit_last->target == pc && jit_last->next->key == jit_key(pc) )
+        block = jit_last->next;
+    else
+        block = jit_lookup(pc);
+    if ( block->count == 0 || block->cycles > budget )
+        return 0;
+
+    jit_cycles = 0;
+
+    if ( jit_verify )
+    {
+        jit_save(&before);
+        if ( block->stores )
+            jit_save_ram(jit_ram_before);
+        jit_budget = 0;
+        exit = ((struct jit_exit *(*)(void))block->code)();
+        cycles_ahead = 0;
+        jit_check(block, &before, exit == &jit_side_exit);
+    }
+    else if ( block->loop )
+        exit = jit_loop(block, budget);
+    else
+    {
+        jit_budget = budget;
+        exit = ((struct jit_exit *(*)(void))block->code)();
+        cycles_ahead = 0;
+    }
+
+    /* A store that has to be interpreted before anything ran */
+    if ( exit == &jit_side_exit && jit_cycles == 0 )
+        return 0;
+
+    cpu_cycles = jit_cycles;
+    jit_chain(exit);
+    return 1;
+}
+
+/* Drop a block whose code was overwritten.  Exits may still be chained to
+ * it, so its body becomes a stub that hands pc back to jit_exec(). */
+void jit_kill ( struct jit_block *block )
+{
+    unsigned char *saved = jit_ptr;
+
+    jit_ptr = block->body;
+    emit_store16_imm(VAR(pc), block->start);
+    emit8(0x48);                        /* movabs rax, &jit_dead_exit */
+    emit8(0xb8);
+    emit64((unsigned long)&jit_dead_exit);
+    emit8(0x5b);                        /* pop rbx */
+    emit8(0xc3);                        /* ret */
+    jit_ptr = saved;
+
+    block->key = JIT_DEAD;
+    if ( jit_smc[block->start >> 8] < JIT_SMC_LIMIT )
+        jit_smc[block->start >> 8]++;
+}
+
+/* Called on writes to a page holding translated code */
+void jit_invalidate ( unsigned short addr )
+{
+    struct jit_block *block;
+    int page;
+
+    /* Blocks are short, so only ones starting on this or the previous page
+     * can cover addr */
+    for ( page = (addr >> 8) - 1; page <= addr >> 8; page++ )
+    {
+        if ( page < 0 )
+            continue;
+
+        for ( block = jit_pages[page]; block; block = block->page_next )
+            if ( block->key != JIT_DEAD && addr >= block->start && addr < block->end )
+                jit_kill(block);
+    }
+}
+
+void init_jit ( char verify )
+{
+    jit_cache = mmap(NULL, JIT_CACHE_SIZE, PROT_READ|PROT_WRITE|PROT_EXEC,
+                     MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    jit_pool = calloc(JIT_MAX_BLOCKS, sizeof(struct jit_block));
+    if ( jit_cache == MAP_FAILED || jit_pool == NULL )
+    {
+        perror("init_jit");
+        exit(EXIT_FAILURE);
+    }
+
+    jit_flush();
+    jit_verify = verify;
+    jit_enabled = 1;
+}
+
+#else
+
+int jit_exec ( unsigned int budget )
+{
+    return 0;
+}
+
+void jit_invalidate ( unsigned short addr )
+{
+}
+
+void jit_flush ( void )
+{
+}
+
+void init_jit ( char verify )
+{
+    fprintf(stderr, "JIT not supported on this host, interpreting\n");
+}
+
+#endif
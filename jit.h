@@ -0,0 +1,51 @@
+void init_jit(char verify);
+int jit_exec(unsigned int budget);
+void jit_invalidate(unsigned short addr);
+void jit_flush(void);
+
+/*
+ * Dynamic recompiler.  Runs of instructions that touch registers, read
+ * memory or store through BC, DE or HL are translated into x86-64 and kept
+ * in a code cache keyed by (bank, pc).  A store only completes in the block
+ * when its page is plain memory; otherwise the block leaves through a side
+ * exit and the interpreter does it.  LDH and absolute stores, CB writes to
+ * (HL), stack ops, CALL/RET and anything else with side effects are not
+ * translated: they end the block and are left to the interpreter.  Blocks
+ * that store nothing and jump back to their own start are idle loop
+ * candidates, fast-forwarded as in the block cache.
+ */
+
+#define JIT_CACHE_SIZE  0x400000 /* Bytes of generated code before a flush */
+#define JIT_HASH_SIZE   0x1000   /* Must be a power of two */
+#define JIT_MAX_OPS     32       /* Guest instructions per block */
+#define JIT_BLOCK_SIZE  (JIT_MAX_OPS * 160 + 256) /* Worst case host bytes */
+#define JIT_SMC_LIMIT   8        /* Overwrites before a page is left interpreted */
+#define JIT_LOOP_TRIES  2        /* Loop iterations checked for idling per entry */
+#define JIT_LOOP_BACKOFF 4       /* Entries a busy loop runs before the next check */
+
+struct jit_exit
+{
+    unsigned short target;
+    unsigned char *patch, *cycles;
+    struct jit_block *from, *next;
+};
+
+struct jit_block
+{
+    unsigned int key;
+    unsigned short start, end;
+    unsigned int count, cycles;
+    char loop, busy, stores;
+    unsigned char *code, *body;
+    struct jit_exit exits[2];
+    struct jit_block *next, *page_next;
+};
+
+#define JIT_DEAD 0xffffffff /* Key of a block whose code was overwritten */
+
+char jit_enabled;
+char jit_verify;
+
+/* Cycles run by the current jit_exec() call and the most it may run */
+unsigned int jit_cycles;
+unsigned int jit_budget;
@@ -1,11 +1,9 @@
-unsigned char P10_input_right;
-unsigned char P11_input_left;
-unsigned char P12_input_up;
-unsigned char P13_input_down;
-unsigned char P14_select_direction_keys;
-unsigned char P15_select_button_keys;
+#include "common.h"
+#include "mem.h"
+#include "io_regs.h"
 
 void init_joypad ( void )
 {
-
+    /* No keys pressed and neither key group selected */
+    IO_REG(JOYP) = 0xcf;
 }
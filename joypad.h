@@ -1,8 +1,3 @@
 void init_joypad(void);
 
-unsigned char P10_input_right;
-unsigned char P11_input_left;
-unsigned char P12_input_up;
-unsigned char P13_input_down;
-unsigned char P14_select_direction_keys;
-unsigned char P15_select_button_keys;
+/* Key state is kept in the low nibble of JOYP, active low */
@@ -5,6 +5,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <signal.h>
 #include "common.h"
 #include "io_regs.h"
 #include "mem.h"
@@ -16,16 +17,108 @@
 #include "timer.h"
 #include "joypad.h"
 #include "serial.h"
+#include "trace.h"
+#include "jit.h"
+#include "block.h"
+#include "save.h"
+#include "watch.h"
+#include "run.h"
 
 #define PAGE_SIZE getpagesize()
+#define MAX_POINTS 16
 
 char *mem_base;
 
+/* Set on SIGINT or SIGTERM to leave the main loop */
+volatile sig_atomic_t quit;
+
+void handle_quit ( int sig )
+{
+    quit = 1;
+}
+
+void print_watch ( unsigned short pc, unsigned short addr, unsigned char old, unsigned char value )
+{
+    fprintf(stderr, "%04x: write %04x %02x -> %02x\n", pc, addr, old, value);
+}
+
+void print_break ( unsigned short pc )
+{
+    fprintf(stderr, "%04x: breakpoint\n", pc);
+}
+
+void usage ( char *progname )
+{
+    fprintf(stderr, "usage: %s [-bijJ] [-B bootrom] [-t tracefile] [-w addr] [-x addr] rom\n", progname);
+    exit(EXIT_FAILURE);
+}
+
 int main ( int argc, char **argv )
 {
+    char *trace_filename = NULL, *boot_filename = NULL;
+    char jit = 0, verify = 0, blocks = 1, boot = 0;
+    unsigned short watches[MAX_POINTS], breaks[MAX_POINTS];
+    int nwatches = 0, nbreaks = 0;
+    int opt, i;
+
+    while ( (opt = getopt(argc, argv, "bB:ijJt:w:x:")) != -1 )
+    {
+        switch ( opt )
+        {
+            /* Run the boot sequence rather than starting after it */
+            case 'b':
+                boot = 1;
+                break;
+
+            /* ... from a DMG or CGB boot ROM image */
+            case 'B':
+                boot = 1;
+                boot_filename = optarg;
+                break;
+
+            /* Decode every instruction as it runs, without the block cache */
+            case 'i':
+                blocks = 0;
+                break;
+
+            case 'j':
+                jit = 1;
+                break;
+
+            /* JIT, checking every block against the interpreter */
+            case 'J':
+                jit = verify = 1;
+                break;
+
+            case 't':
+                trace_filename = optarg;
+                break;
+
+            /* Log writes to a hex address */
+            case 'w':
+                if ( nwatches == MAX_POINTS )
+                    usage(argv[0]);
+                watches[nwatches++] = strtoul(optarg, NULL, 16);
+                break;
+
+            /* Log each time pc reaches a hex address */
+            case 'x':
+                if ( nbreaks == MAX_POINTS )
+                    usage(argv[0]);
+                breaks[nbreaks++] = strtoul(optarg, NULL, 16);
+                break;
+
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if ( optind >= argc )
+        usage(argv[0]);
+
     init_mem();
-    init_rom(argv[1]);
     init_cpu();
+    init_rom(argv[optind]);
     init_interrupt();
     init_audio();
     init_video();
@@ -33,14 +126,36 @@ int main ( int argc, char **argv )
     init_joypad();
     init_serial();
 
+    if ( boot )
+        enable_bootROM(boot_filename);
+
+    if ( trace_filename )
+        init_trace(trace_filename);
+
+    if ( blocks )
+        init_block();
+
+    if ( jit )
+        init_jit(verify);
+
+    watch_hook = print_watch;
+    break_hook = print_break;
+    for ( i = 0; i < nwatches; i++ )
+        add_watchpoint(watches[i], WATCH_WRITE);
+    for ( i = 0; i < nbreaks; i++ )
+        add_breakpoint(breaks[i]);
+
+    signal(SIGINT, handle_quit);
+    signal(SIGTERM, handle_quit);
+
     /* Main loop */
-    while ( 1 )
-    {
-        exec_instruction();
-        check_interrupts();
-        cycle_video();
-        cycle_timer();
-    }
+    while ( !quit )
+        run_frame();
+
+    exit_save();
+
+    if ( blocks || jit )
+        fprintf(stderr, "%lu cycles skipped in idle loops\n", idle_cycles);
 
     return 0;
 }
@@ -0,0 +1,422 @@
+#include <sys/mman.h>
+#include <time.h>
+#include "common.h"
+#include "cpu.h"
+#include "mem.h"
+#include "mbc.h"
+#include "save.h"
+
+unsigned char mbc_type;
+unsigned char mbc_battery;
+unsigned char mbc_rtc;
+
+char *rom_data;
+unsigned int rom_banks;
+char *cart_ram;
+unsigned int cart_ram_size;
+
+unsigned int rom_bank0;
+unsigned int rom_bank;
+unsigned int ram_bank;
+unsigned char ram_enabled;
+
+unsigned char mbc1_bank_lo;
+unsigned char mbc1_bank_hi;
+unsigned char mbc1_mode;
+
+unsigned long long rtc_time;
+unsigned int rtc_cycles;
+unsigned char rtc_halt;
+unsigned char rtc_carry;
+unsigned char rtc_latched[5];
+unsigned char rtc_latch;
+
+/* Where a ROM page currently reads from */
+char *mbc_rom_page ( unsigned int page )
+{
+    unsigned int bank = page < (ROM_BANK_N >> 8) ? rom_bank0 : rom_bank;
+
+    if ( rom_data == NULL )
+        return NULL;
+
+    return rom_data + bank * ROM_BANK_SIZE + ((page << 8) & (ROM_BANK_SIZE - 1));
+}
+
+/* Where a cartridge RAM page currently reads from, or NULL if it is
+ * disabled, missing or not RAM */
+char *mbc_ram_page ( unsigned int page )
+{
+    if ( !ram_enabled || cart_ram_size == 0 )
+        return NULL;
+
+    /* MBC3 RTC registers */
+    if ( mbc_type == MBC3 && ram_bank >= 0x8 )
+        return NULL;
+
+    /* Small RAMs repeat through the window */
+    return cart_ram + ((ram_bank * RAM_BANK_SIZE + ((page << 8) & (RAM_BANK_SIZE - 1))) & (cart_ram_size - 1));
+}
+
+void map_ram_pages ( void )
+{
+    unsigned int page;
+
+    for ( page = EXTERNAL_RAM >> 8; page < (INTERNAL_RAM >> 8); page++ )
+        map_page(page);
+}
+
+/* Switch banks, repointing only the windows whose mapping changed */
+void mbc_map ( unsigned int bank0, unsigned int bank, unsigned int rbank, unsigned char enabled )
+{
+    unsigned int page;
+
+    bank0 &= rom_banks - 1;
+    bank &= rom_banks - 1;
+
+    if ( bank0 != rom_bank0 )
+    {
+        rom_bank0 = bank0;
+        for ( page = 0; page < (ROM_BANK_N >> 8); page++ )
+            map_page(page);
+    }
+
+    if ( bank != rom_bank )
+    {
+        rom_bank = bank;
+        for ( page = ROM_BANK_N >> 8; page < (CHARACTER_RAM >> 8); page++ )
+            map_page(page);
+    }
+
+    if ( rbank != ram_bank || enabled != ram_enabled )
+    {
+        ram_bank = rbank;
+        ram_enabled = enabled;
+        map_ram_pages();
+    }
+}
+
+void mbc1_write ( unsigned short addr, char value )
+{
+    unsigned char enabled = ram_enabled;
+
+    switch ( addr >> 13 )
+    {
+        case 0:
+            enabled = (value & 0xf) == 0xa;
+            break;
+
+        case 1:
+            mbc1_bank_lo = value & 0x1f;
+            if ( mbc1_bank_lo == 0 )
+                mbc1_bank_lo = 1;
+            break;
+
+        case 2:
+            mbc1_bank_hi = value & 0x3;
+            break;
+
+        case 3:
+            mbc1_mode = value & 0x1;
+            break;
+    }
+
+    /* The upper bits select the RAM bank, and the bank at 0x0000 on large
+     * ROMs, only in mode 1 */
+    mbc_map(mbc1_mode ? mbc1_bank_hi << 5 : 0, (mbc1_bank_hi << 5) | mbc1_bank_lo,
+            mbc1_mode ? mbc1_bank_hi : 0, enabled);
+}
+
+void mbc2_write ( unsigned short addr, char value )
+{
+    unsigned int bank = value & 0xf;
+
+    if ( addr >= ROM_BANK_N )
+        return;
+
+    /* Address bit 8 selects between RAM enable and the ROM bank */
+    if ( addr & 0x100 )
+        mbc_map(0, bank ? bank : 1, 0, ram_enabled);
+    else
+        mbc_map(0, rom_bank, 0, (value & 0xf) == 0xa);
+}
+
+/* Fold whole seconds since rtc_cycles into rtc_time.  The day counter
+ * wraps at 512 days, setting the sticky carry. */
+void rtc_sync ( void )
+{
+    unsigned int secs;
+
+    if ( rtc_halt )
+        return;
+
+    secs = (total_cpu_cycles - rtc_cycles) / RTC_HZ;
+    rtc_time += secs;
+    rtc_cycles += secs * RTC_HZ;
+
+    if ( rtc_time >= (unsigned long long)RTC_DAYS * RTC_DAY )
+    {
+        rtc_time %= (unsigned long long)RTC_DAYS * RTC_DAY;
+        rtc_carry = 1;
+    }
+}
+
+/* The clock registers as they read now */
+void rtc_get ( unsigned char regs[5] )
+{
+    unsigned int days;
+
+    rtc_sync();
+    days = rtc_time / RTC_DAY;
+    regs[0] = rtc_time % 60;
+    regs[1] = rtc_time / 60 % 60;
+    regs[2] = rtc_time / 3600 % 24;
+    regs[3] = days;
+    regs[4] = (days >> 8) | (rtc_halt ? RTC_DH_HALT : 0) | (rtc_carry ? RTC_DH_CARRY : 0);
+}
+
+void rtc_set ( const unsigned char regs[5] )
+{
+    unsigned int days = ((regs[4] & 0x1) << 8) | regs[3];
+
+    rtc_time = (unsigned long long)days * RTC_DAY + (regs[2] & 0x1f) * 3600 +
+               (regs[1] & 0x3f) * 60 + (regs[0] & 0x3f);
+
+    /* The clock restarts from a whole second when it is resumed */
+    if ( rtc_halt && !(regs[4] & RTC_DH_HALT) )
+        rtc_cycles = total_cpu_cycles;
+    rtc_halt = (regs[4] & RTC_DH_HALT) != 0;
+    rtc_carry = (regs[4] & RTC_DH_CARRY) != 0;
+}
+
+/* Whether a clock register is mapped at 0xa000 */
+int rtc_selected ( void )
+{
+    return mbc_rtc && ram_enabled && ram_bank >= RTC_S && ram_bank <= RTC_DH;
+}
+
+char rtc_read ( void )
+{
+    return rtc_latched[ram_bank - RTC_S];
+}
+
+void rtc_write ( char value )
+{
+    unsigned char regs[5];
+
+    rtc_get(regs);
+    regs[ram_bank - RTC_S] = value;
+    rtc_set(regs);
+
+    /* Writing the seconds also clears the part-second count */
+    if ( ram_bank == RTC_S )
+        rtc_cycles = total_cpu_cycles;
+
+    save_pending = 1;
+}
+
+void put32 ( unsigned char *buf, unsigned int value )
+{
+    buf[0] = value;
+    buf[1] = value >> 8;
+    buf[2] = value >> 16;
+    buf[3] = value >> 24;
+}
+
+unsigned int get32 ( const unsigned char *buf )
+{
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((unsigned int)buf[3] << 24);
+}
+
+/* Save the clock along with the host time, so it keeps running while the
+ * emulator is not */
+void rtc_save ( unsigned char *buf )
+{
+    unsigned char regs[5];
+    unsigned long long now = time(NULL);
+    int i;
+
+    rtc_get(regs);
+    for ( i = 0; i < 5; i++ )
+    {
+        put32(buf + i * 4, regs[i]);
+        put32(buf + 20 + i * 4, rtc_latched[i]);
+    }
+    put32(buf + 40, now);
+    put32(buf + 44, now >> 32);
+}
+
+void rtc_load ( const unsigned char *buf )
+{
+    unsigned char regs[5];
+    unsigned long long then = get32(buf + 40) | ((unsigned long long)get32(buf + 44) << 32);
+    unsigned long long now = time(NULL);
+    int i;
+
+    for ( i = 0; i < 5; i++ )
+    {
+        regs[i] = get32(buf + i * 4);
+        rtc_latched[i] = get32(buf + 20 + i * 4);
+    }
+
+    rtc_halt = 0;
+    rtc_set(regs);
+    rtc_cycles = total_cpu_cycles;
+    if ( !rtc_halt && now > then )
+    {
+        rtc_time += now - then;
+        rtc_sync();
+    }
+}
+
+void mbc3_write ( unsigned short addr, char value )
+{
+    unsigned int bank = value & 0x7f;
+
+    switch ( addr >> 13 )
+    {
+        case 0:
+            mbc_map(0, rom_bank, ram_bank, (value & 0xf) == 0xa);
+            break;
+
+        case 1:
+            mbc_map(0, bank ? bank : 1, ram_bank, ram_enabled);
+            break;
+
+        case 2:
+            mbc_map(0, rom_bank, value & 0xf, ram_enabled);
+            break;
+
+        case 3:
+            /* Writing 0 then 1 latches the clock */
+            if ( mbc_rtc && rtc_latch == 0 && value == 1 )
+                rtc_get(rtc_latched);
+            rtc_latch = value;
+            break;
+    }
+}
+
+void mbc5_write ( unsigned short addr, char value )
+{
+    switch ( addr >> 12 )
+    {
+        case 0: case 1:
+            mbc_map(0, rom_bank, ram_bank, (value & 0xf) == 0xa);
+            break;
+
+        case 2:
+            mbc_map(0, (rom_bank & 0x100) | (unsigned char)value, ram_bank, ram_enabled);
+            break;
+
+        case 3:
+            mbc_map(0, (rom_bank & 0xff) | ((value & 0x1) << 8), ram_bank, ram_enabled);
+            break;
+
+        case 4: case 5:
+            mbc_map(0, rom_bank, value & 0xf, ram_enabled);
+            break;
+    }
+}
+
+/* Called on writes to 0x0000-0x7fff */
+void mbc_write ( unsigned short addr, char value )
+{
+    switch ( mbc_type )
+    {
+        case MBC1:
+            mbc1_write(addr, value);
+            break;
+
+        case MBC2:
+            mbc2_write(addr, value);
+            break;
+
+        case MBC3:
+            mbc3_write(addr, value);
+            break;
+
+        case MBC5:
+            mbc5_write(addr, value);
+            break;
+    }
+}
+
+/* Set up the controller named in the header of the ROM at rom_data */
+void init_mbc ( void )
+{
+    unsigned int page;
+
+    switch ( (unsigned char)rom_data[CART_TYPE] )
+    {
+        case 0x00: case 0x08: case 0x09:
+            mbc_type = MBC_NONE;
+            break;
+
+        case 0x01: case 0x02: case 0x03:
+            mbc_type = MBC1;
+            break;
+
+        case 0x05: case 0x06:
+            mbc_type = MBC2;
+            break;
+
+        case 0x0f: case 0x10:
+            mbc_rtc = 1;
+            mbc_type = MBC3;
+            break;
+
+        case 0x11: case 0x12: case 0x13:
+            mbc_type = MBC3;
+            break;
+
+        case 0x19: case 0x1a: case 0x1b: case 0x1c: case 0x1d: case 0x1e:
+            mbc_type = MBC5;
+            break;
+
+        default:
+            fprintf(stderr, "Unsupported cartridge type 0x%02hhx\n", rom_data[CART_TYPE]);
+            exit(EXIT_FAILURE);
+    }
+
+    switch ( (unsigned char)rom_data[CART_TYPE] )
+    {
+        case 0x03: case 0x06: case 0x09: case 0x0f: case 0x10: case 0x13: case 0x1b: case 0x1e:
+            mbc_battery = 1;
+            break;
+    }
+
+    /* MBC2 has 512 half-bytes built in */
+    switch ( mbc_type == MBC2 ? -1 : rom_data[CART_RAM_SIZE] )
+    {
+        case -1: cart_ram_size = 0x200;   break;
+        case 1:  cart_ram_size = 0x800;   break;
+        case 2:  cart_ram_size = 0x2000;  break;
+        case 3:  cart_ram_size = 0x8000;  break;
+        case 4:  cart_ram_size = 0x20000; break;
+        case 5:  cart_ram_size = 0x10000; break;
+        default: cart_ram_size = 0;       break;
+    }
+
+    if ( cart_ram_size )
+    {
+        cart_ram = (char *)mmap(NULL, cart_ram_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if ( cart_ram == MAP_FAILED )
+        {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* Cartridges without a controller have their RAM always enabled */
+    rom_bank0 = 0;
+    rom_bank = 1;
+    ram_bank = 0;
+    ram_enabled = mbc_type == MBC_NONE;
+    mbc1_bank_lo = 1;
+    mbc1_bank_hi = 0;
+    mbc1_mode = 0;
+    rtc_time = 0;
+    rtc_cycles = total_cpu_cycles;
+
+    for ( page = 0; page < 0x100; page++ )
+        map_page(page);
+}
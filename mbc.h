@@ -0,0 +1,81 @@
+void init_mbc(void);
+void mbc_write(unsigned short addr, char value);
+char *mbc_rom_page(unsigned int page);
+char *mbc_ram_page(unsigned int page);
+void map_ram_pages(void);
+int rtc_selected(void);
+char rtc_read(void);
+void rtc_write(char value);
+void rtc_sync(void);
+void rtc_save(unsigned char *buf);
+void rtc_load(const unsigned char *buf);
+
+/*
+ * Memory bank controller.  The whole ROM file is mapped read-only at
+ * rom_data, so switching banks only repoints the pages of the switchable
+ * windows in the page table; nothing is copied.
+ */
+
+#define ROM_BANK_SIZE 0x4000
+#define RAM_BANK_SIZE 0x2000
+
+/* Cartridge header */
+#define CART_TYPE     0x147
+#define CART_ROM_SIZE 0x148
+#define CART_RAM_SIZE 0x149
+
+#define MBC_NONE 0
+#define MBC1     1
+#define MBC2     2
+#define MBC3     3
+#define MBC5     5
+
+unsigned char mbc_type;
+unsigned char mbc_battery;
+unsigned char mbc_rtc;
+
+char *rom_data;
+unsigned int rom_banks;     /* Power of two */
+char *cart_ram;
+unsigned int cart_ram_size; /* Power of two, or 0 without RAM */
+
+unsigned int rom_bank0;     /* Bank at 0x0000 */
+unsigned int rom_bank;      /* Bank at 0x4000 */
+unsigned int ram_bank;      /* Bank at 0xa000, or an MBC3 RTC register */
+unsigned char ram_enabled;
+
+/* MBC1 bank registers and banking mode */
+unsigned char mbc1_bank_lo;
+unsigned char mbc1_bank_hi;
+unsigned char mbc1_mode;
+
+/*
+ * MBC3 real-time clock.  Nothing ticks: the clock is kept as the seconds it
+ * showed at rtc_cycles, and the time is only worked out from
+ * total_cpu_cycles when the game latches or writes it.  Reads return the
+ * latched copy.
+ */
+
+#define RTC_S  0x08 /* Bank numbers of the clock registers */
+#define RTC_M  0x09
+#define RTC_H  0x0a
+#define RTC_DL 0x0b
+#define RTC_DH 0x0c
+
+#define RTC_DH_HALT  0x40
+#define RTC_DH_CARRY 0x80
+
+#define RTC_HZ       4194304
+#define RTC_DAY      86400
+#define RTC_DAYS     512
+
+/* Registers, latched registers and a timestamp, as 32-bit and 64-bit
+ * little-endian words after the RAM in the .sav file */
+#define RTC_SAVE_SIZE 48
+
+unsigned long long rtc_time; /* Seconds on the clock at rtc_cycles */
+unsigned int rtc_cycles;
+unsigned char rtc_halt;
+unsigned char rtc_carry;
+unsigned char rtc_latched[5];
+unsigned char rtc_latch;     /* Last write to the latch register */
@@ -2,43 +2,336 @@
 #include "common.h"
 #include "rom.h"
 #include "io_regs.h"
+#include "mem.h"
+#include "mbc.h"
+#include "save.h"
+#include "dma.h"
+#include "cgb.h"
+#include "watch.h"
+#include "jit.h"
+#include "block.h"
 
 char *mem_base;
+unsigned char code_pages[0x100];
+char *read_page[0x100];
+char *write_page[0x100];
+char *mem_page[0x100];
+char timed_read;
+unsigned int timed_until;
+char *vram;
+char *wram;
+unsigned char vram_bank;
+unsigned char wram_bank;
 
 char get_mem8 ( unsigned short addr )
 {
-    char tmp;
+    char *page = read_page[addr >> 8];
 
-    if ( handle_ioregs_read(addr, &tmp) )
-        return tmp;
-    else
-        return *(mem_base + addr);
+    if ( page )
+        return page[addr & 0xff];
+
+    /* I/O registers computed from the cycle counter */
+    if ( addr >= HARDWARE_IO_REGS && io_read[addr & 0xff] )
+        io_read[addr & 0xff](addr);
+
+    if ( watch_pages[addr >> 8] )
+        return watch_read(addr);
+
+    /* MBC3 clock registers are banked in over cartridge RAM */
+    if ( addr >= EXTERNAL_RAM && addr < INTERNAL_RAM && rtc_selected() && !dma_active )
+        return rtc_read();
+
+    /* The rest of the I/O page */
+    if ( (page = mem_page[addr >> 8]) )
+        return page[addr & 0xff];
+
+    /* Disabled or missing cartridge RAM, or the bus is locked by OAM DMA */
+    return 0xff;
+}
+
+/* Called by read handlers: the value just read holds until when */
+void read_until ( unsigned int when )
+{
+    if ( !timed_read || (int)(when - timed_until) < 0 )
+        timed_until = when;
+    timed_read = 1;
+}
+
+/* Both bytes come from one page, in a single little-endian load, unless addr
+ * is the last byte of it; then each goes its own way, wrapping from 0xffff
+ * to 0x0000 */
+/* Read a byte as get_mem8 does, but without running I/O read handlers or
+ * watchpoint hooks, for instruction fetch and the tracer.  Only data reads
+ * the program makes are visible to them. */
+char peek_mem8 ( unsigned short addr )
+{
+    char *page = read_page[addr >> 8];
+
+    if ( page )
+        return page[addr & 0xff];
+
+    if ( addr >= EXTERNAL_RAM && addr < INTERNAL_RAM && rtc_selected() && !dma_active )
+        return rtc_read();
+
+    if ( (page = mem_page[addr >> 8]) )
+        return page[addr & 0xff];
+
+    return 0xff;
 }
 
 short get_mem16 ( unsigned short addr )
 {
-    return *(short *)(mem_base + addr);
+    char *page = read_page[addr >> 8];
+    short value;
+
+    if ( page && (addr & 0xff) != 0xff )
+    {
+        memcpy(&value, page + (addr & 0xff), sizeof(value));
+        return value;
+    }
+
+    return (unsigned char)get_mem8(addr) | (get_mem8(addr + 1) << 8);
 }
 
 void set_mem8 ( unsigned short addr, char value )
 {
-    if ( handle_ioregs_write(addr, value) )
+    char *page = write_page[addr >> 8];
+
+    if ( page )
+    {
+        page[addr & 0xff] = value;
+        return;
+    }
+
+    /* Only the 0xff00 page is reachable while OAM DMA holds the bus */
+    if ( dma_active && addr < HARDWARE_IO_REGS )
+        return;
+
+    if ( watch_flags[addr] & WATCH_WRITE )
+        watch_write(addr, value);
+
+    /* ROM is read-only; writes to it program the bank controller */
+    if ( addr < CHARACTER_RAM )
+    {
+        mbc_write(addr, value);
         return;
-    else
-        *(mem_base + addr) = value;
+    }
+
+    if ( code_pages[addr >> 8] )
+        invalidate_code(addr);
+
+    /* Otherwise store to the page's backing memory, if it has any */
+    if ( addr >= HARDWARE_IO_REGS && io_write[addr & 0xff] )
+        io_write[addr & 0xff](addr, value);
+    else if ( (page = mem_page[addr >> 8]) )
+    {
+        page[addr & 0xff] = value;
+        if ( addr >= EXTERNAL_RAM && addr < INTERNAL_RAM )
+            save_touch(addr);
+    }
+    else if ( addr >= EXTERNAL_RAM && addr < INTERNAL_RAM && rtc_selected() )
+    {
+        rtc_write(value);
+    }
 }
 
 void set_mem16 ( unsigned short addr, short value )
 {
-    *(short *)(mem_base + addr) = value;
+    char *page = write_page[addr >> 8];
+
+    if ( page && (addr & 0xff) != 0xff )
+    {
+        memcpy(page + (addr & 0xff), &value, sizeof(value));
+        return;
+    }
+
+    set_mem8(addr, value);
+    set_mem8(addr + 1, value >> 8);
+}
+
+/* Point a page at its backing memory, or at the slow path if accesses to it
+ * have side effects.  The I/O page always takes the slow path, through the
+ * io_read[] and io_write[] handler tables, and watched pages trap both reads
+ * and writes. */
+void map_page ( unsigned int page )
+{
+    char *base = mem_base + (page << 8);
+    int readable = page != (HARDWARE_IO_REGS >> 8);
+    int writable = readable;
+
+    if ( dma_active && page != (HARDWARE_IO_REGS >> 8) )
+    {
+        base = NULL;
+    }
+    /* ROM goes through the boot ROM overlay or the bank controller, and is
+     * never written directly */
+    else if ( page < (CHARACTER_RAM >> 8) )
+    {
+        base = boot_rom_page(page);
+        if ( !base )
+            base = mbc_rom_page(page);
+        writable = 0;
+    }
+    /* Video and work RAM point into their current bank; the echo pages
+     * point at the same work RAM, so it is mirrored without any copying */
+    else if ( page >= (CHARACTER_RAM >> 8) && page < (EXTERNAL_RAM >> 8) )
+    {
+        base = vram + vram_bank * VRAM_BANK_SIZE + ((page << 8) & (VRAM_BANK_SIZE - 1));
+    }
+    else if ( page >= (INTERNAL_RAM >> 8) && page < (OBJECT_ATTRIBUTE >> 8) )
+    {
+        base = wram + ((page << 8) & WRAM_BANK_SIZE ? wram_bank * WRAM_BANK_SIZE : 0) +
+               ((page << 8) & (WRAM_BANK_SIZE - 1));
+    }
+    /* Battery RAM is only written directly once its page is dirty */
+    else if ( page >= (EXTERNAL_RAM >> 8) && page < (INTERNAL_RAM >> 8) )
+    {
+        base = mbc_ram_page(page);
+        writable = base && save_page_writable(base);
+    }
+
+    mem_page[page] = base;
+    read_page[page] = readable && !watch_pages[page] ? base : NULL;
+    write_page[page] = writable && !code_pages[page] && !watch_pages[page] ? base : NULL;
+}
+
+/* The other page showing the same memory, for work RAM and its echo, or -1 */
+int mirror_page ( unsigned int page )
+{
+    if ( page >= (INTERNAL_RAM >> 8) && page < ((OBJECT_ATTRIBUTE - ECHO_OFFSET) >> 8) )
+        return page + (ECHO_OFFSET >> 8);
+    if ( page >= (RESERVED_AREA >> 8) && page < (OBJECT_ATTRIBUTE >> 8) )
+        return page - (ECHO_OFFSET >> 8);
+    return -1;
+}
+
+/* Note that page holds code cached by owner, so writes to it, or to its
+ * mirror, get checked.  Writes to ROM only reach the bank controller, so
+ * code cached from it is never overwritten and needs no tracking. */
+void mark_code_page ( unsigned int page, unsigned char owner )
+{
+    int mirror = mirror_page(page);
+
+    if ( page < (CHARACTER_RAM >> 8) )
+        return;
+
+    code_pages[page] |= owner;
+    write_page[page] = NULL;
+
+    if ( mirror >= 0 )
+    {
+        code_pages[mirror] |= owner;
+        write_page[mirror] = NULL;
+    }
+}
+
+/* Forget all pages cached by owner */
+void unmark_code_pages ( unsigned char owner )
+{
+    unsigned int page;
+
+    for ( page = 0; page < 0x100; page++ )
+    {
+        if ( code_pages[page] & owner )
+        {
+            code_pages[page] &= ~owner;
+            map_page(page);
+        }
+    }
+}
+
+/* Code is cached from ROM bank 0, the switchable bank, video RAM, cartridge
+ * RAM, work RAM bank 0 and its echo, HRAM, or the switchable work RAM bank
+ * and its echo; I/O and OAM are always interpreted */
+int code_region ( unsigned short addr )
+{
+    if ( addr < ROM_BANK_N )
+        return 0;
+    if ( addr < CHARACTER_RAM )
+        return 1;
+    if ( addr < EXTERNAL_RAM )
+        return 2;
+    if ( addr < INTERNAL_RAM )
+        return 3;
+    if ( addr < OBJECT_ATTRIBUTE )
+        return addr & WRAM_BANK_SIZE ? 6 : 4;
+    if ( addr >= HIGH_RAM_AREA && addr < INTERRUPT_ENABLE )
+        return 5;
+    return -1;
+}
+
+/* Bank mapped at addr, so cached code in different banks never aliases */
+unsigned int code_bank ( unsigned short addr )
+{
+    switch ( code_region(addr) )
+    {
+        case 0: return rom_bank0;
+        case 1: return rom_bank;
+        case 2: return vram_bank;
+        case 3: return ram_bank;
+        case 6: return wram_bank;
+    }
+
+    return 0;
+}
+
+/* Whether the bank mapped at addr can change under code cached elsewhere */
+int code_switchable ( unsigned short addr )
+{
+    switch ( code_region(addr) )
+    {
+        case 0: return mbc_type == MBC1 && rom_banks > 0x20;
+        case 1: return 1;
+        case 2: return cgb_mode;
+        case 3: return 1;
+        case 6: return cgb_mode;
+    }
+
+    return 0;
+}
+
+/* Drop translated and decoded code covering addr after a write to it */
+void invalidate_code ( unsigned short addr )
+{
+    int mirror = mirror_page(addr >> 8);
+
+    if ( code_pages[addr >> 8] & CODE_JIT )
+        jit_invalidate(addr);
+    if ( code_pages[addr >> 8] & CODE_BLOCK )
+        block_invalidate(addr);
+
+    /* Code cached through the mirror was decoded from the same bytes */
+    if ( mirror >= 0 )
+    {
+        if ( code_pages[mirror] & CODE_JIT )
+            jit_invalidate((mirror << 8) | (addr & 0xff));
+        if ( code_pages[mirror] & CODE_BLOCK )
+            block_invalidate((mirror << 8) | (addr & 0xff));
+    }
 }
 
 void init_mem ( void )
 {
+    unsigned int page;
+
     mem_base = (char *)mmap(NULL, 0x10000, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, 0, 0);
     if ( mem_base == MAP_FAILED )
     {
         perror("mmap");
         exit(EXIT_FAILURE);
     }
+
+    vram = (char *)mmap(NULL, 2 * VRAM_BANK_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    wram = (char *)mmap(NULL, 8 * WRAM_BANK_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if ( vram == MAP_FAILED || wram == MAP_FAILED )
+    {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    vram_bank = 0;
+    wram_bank = 1;
+
+    for ( page = 0; page < 0x100; page++ )
+        map_page(page);
 }
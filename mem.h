@@ -1,11 +1,58 @@
 void init_mem(void);
 char get_mem8(unsigned short addr);
+char peek_mem8(unsigned short addr);
 short get_mem16(unsigned short addr);
 void set_mem8(unsigned short addr, char value);
 void set_mem16(unsigned short addr, short vale);
+int mirror_page(unsigned int page);
+int code_region(unsigned short addr);
+unsigned int code_bank(unsigned short addr);
+int code_switchable(unsigned short addr);
+void invalidate_code(unsigned short addr);
+void map_page(unsigned int page);
+void read_until(unsigned int when);
+void mark_code_page(unsigned int page, unsigned char owner);
+void unmark_code_pages(unsigned char owner);
 
 char *mem_base;
 
+/* Pages holding code the JIT has translated or the block cache has decoded;
+ * writes there invalidate it */
+unsigned char code_pages[0x100];
+
+#define CODE_JIT   0x1
+#define CODE_BLOCK 0x2
+
+/*
+ * Page table.  Each 256-byte page has a direct read and write pointer; a
+ * NULL entry sends accesses down the slow path, for the I/O page, writes to
+ * ROM and pages holding cached code, reads of disabled cartridge RAM, and
+ * both on watched pages.  mem_page is the backing
+ * memory the slow path falls back to.
+ */
+char *read_page[0x100];
+char *write_page[0x100];
+char *mem_page[0x100];
+
+/* Set when a read handler returns a register that changes between events,
+ * with the earliest cycle one read since timed_read was cleared changes at,
+ * so idle loop skipping stops there */
+char timed_read;
+unsigned int timed_until;
+
+/* Video and work RAM live outside mem_base so the Color GameBoy banks can be
+ * swapped in by repointing their pages */
+#define VRAM_BANK_SIZE 0x2000
+#define WRAM_BANK_SIZE 0x1000
+
+char *vram;                /* 2 banks */
+char *wram;                /* 8 banks */
+unsigned char vram_bank;   /* Bank at 0x8000 */
+unsigned char wram_bank;   /* Bank at 0xd000 */
+
+/* 0xe000-0xfdff echoes work RAM */
+#define ECHO_OFFSET (RESERVED_AREA - INTERNAL_RAM)
+
 #define INTERRUPT_VECTOR    0x0
 #define V_BLANK_INT         0x40
 #define LCD_STAT_INT        0x48
@@ -20,6 +67,7 @@ char *mem_base;
 #define BG_MAP_DATA_2       0x9c00
 #define EXTERNAL_RAM        0xa000
 #define INTERNAL_RAM        0xc000
+#define WRAM_BANK_N         0xd000
 #define RESERVED_AREA       0xe000
 #define OBJECT_ATTRIBUTE    0xfe00
 #define UNUSED              0xfea0
@@ -0,0 +1,164 @@
+#include "common.h"
+#include "tables.h"
+
+/*
+ * mktables: generate the ALU lookup tables in tables.c.  Everything here is
+ * written the slow, obvious way so that the output can serve as the
+ * reference for the flag logic used by the CPU core.
+ */
+
+#define Z 0x80
+#define N 0x40
+#define H 0x20
+#define C 0x10
+
+unsigned char add_flags ( int x, int y, int carry )
+{
+    int result = x + y + carry;
+
+    return (((result & 0xff) == 0) ? Z : 0) |
+           ((((x & 0xf) + (y & 0xf) + carry) > 0xf) ? H : 0) |
+           ((result > 0xff) ? C : 0);
+}
+
+unsigned char sub_flags ( int x, int y, int carry )
+{
+    int result = x - y - carry;
+
+    return (((result & 0xff) == 0) ? Z : 0) | N |
+           ((((x & 0xf) - (y & 0xf) - carry) < 0) ? H : 0) |
+           ((result < 0) ? C : 0);
+}
+
+unsigned short daa ( int x, int flags )
+{
+    int carry = flags & C;
+
+    if ( !(flags & N) )
+    {
+        if ( carry || x > 0x99 )
+        {
+            x += 0x60;
+            carry = C;
+        }
+        if ( (flags & H) || (x & 0xf) > 0x9 )
+            x += 0x6;
+    }
+    else
+    {
+        if ( carry )
+            x -= 0x60;
+        if ( flags & H )
+            x -= 0x6;
+    }
+
+    x &= 0xff;
+    return (x << 8) | ((x == 0) ? Z : 0) | (flags & N) | carry;
+}
+
+unsigned short shift ( int op, int x, int carry )
+{
+    int result, out;
+
+    switch ( op )
+    {
+        case SHIFT_RLC:
+            out = x >> 7;
+            result = (x << 1) | out;
+            break;
+
+        case SHIFT_RRC:
+            out = x & 1;
+            result = (x >> 1) | (out << 7);
+            break;
+
+        case SHIFT_RL:
+            out = x >> 7;
+            result = (x << 1) | carry;
+            break;
+
+        case SHIFT_RR:
+            out = x & 1;
+            result = (x >> 1) | (carry << 7);
+            break;
+
+        case SHIFT_SLA:
+            out = x >> 7;
+            result = x << 1;
+            break;
+
+        case SHIFT_SRA:
+            out = x & 1;
+            result = (x >> 1) | (x & 0x80);
+            break;
+
+        case SHIFT_SWAP:
+            out = 0;
+            result = ((x & 0xf) << 4) | (x >> 4);
+            break;
+
+        default: /* SHIFT_SRL */
+            out = x & 1;
+            result = x >> 1;
+            break;
+    }
+
+    result &= 0xff;
+    return (result << 8) | ((result == 0) ? Z : 0) | (out ? C : 0);
+}
+
+/* Print a table body, eight entries per line */
+void emit ( char *decl, unsigned int count, unsigned short (*entry)(unsigned int) )
+{
+    unsigned int i;
+
+    printf("%s = {\n", decl);
+    for ( i = 0; i < count; i++ )
+        printf("%s0x%04x%s", (i % 8) ? " " : "    ", entry(i), (i == count - 1) ? "\n" : ((i % 8) == 7) ? ",\n" : ",");
+    printf("};\n\n");
+}
+
+unsigned short add_entry ( unsigned int i )
+{
+    return add_flags((i >> 8) & 0xff, i & 0xff, i >> 16);
+}
+
+unsigned short sub_entry ( unsigned int i )
+{
+    return sub_flags((i >> 8) & 0xff, i & 0xff, i >> 16);
+}
+
+unsigned short inc_entry ( unsigned int i )
+{
+    return add_flags(i, 1, 0) & ~C;
+}
+
+unsigned short dec_entry ( unsigned int i )
+{
+    return sub_flags(i, 1, 0) & ~C;
+}
+
+unsigned short daa_entry ( unsigned int i )
+{
+    return daa(i & 0xff, (i >> 8) << 4);
+}
+
+unsigned short shift_entry ( unsigned int i )
+{
+    return shift(i >> 9, i & 0xff, (i >> 8) & 1);
+}
+
+int main ( void )
+{
+    printf("/* Generated by mktables; do not edit */\n\n");
+    printf("#include \"tables.h\"\n\n");
+
+    emit("const unsigned char alu_add_table[2 * 256 * 256]", 2 * 256 * 256, add_entry);
+    emit("const unsigned char alu_sub_table[2 * 256 * 256]", 2 * 256 * 256, sub_entry);
+    emit("const unsigned char inc_flags_table[256]", 256, inc_entry);
+    emit("const unsigned char dec_flags_table[256]", 256, dec_entry);
+    emit("const unsigned short daa_table[8 * 256]", 8 * 256, daa_entry);
+    emit("const unsigned short shift_table[8 * 2 * 256]", 8 * 2 * 256, shift_entry);
+
+    return 0;
+}
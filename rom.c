@@ -2,12 +2,22 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include "common.h"
 #include "cpu.h"
+#include "interrupt.h"
 #include "mem.h"
 #include "io_regs.h"
+#include "mbc.h"
+#include "save.h"
+#include "cgb.h"
+#include "jit.h"
+#include "block.h"
+#include "rom.h"
 
-char tmp_storage[256];
+char boot_rom[CGB_BOOT_ROM_SIZE];
+unsigned int boot_rom_size;
+char boot_rom_mapped;
 
 char gb_boot_rom[256] =
 "\x31\xfe\xff\xaf\x21\xff\x9f\x32\xcb\x7c\x20\xfb\x21\x26\xff\x0e"
@@ -27,25 +37,110 @@ char gb_boot_rom[256] =
 "\x21\x04\x01\x11\xa8\x00\x1a\x13\xbe\x20\xfe\x23\x7d\xfe\x34\x20"
 "\xf5\x06\x19\x78\x86\x23\x05\x20\xfb\x86\x20\xfe\x3e\x01\xe0\x50";
 
-void enable_bootROM ( void )
+/* Overlay page over the cartridge while the boot ROM is mapped, or NULL.
+ * The CGB boot ROM leaves a gap at 0x100-0x1ff for the cartridge header. */
+char *boot_rom_page ( unsigned int page )
 {
-    memcpy(tmp_storage, mem_base,  256);
-    memcpy(mem_base, gb_boot_rom, 256);
+    if ( !boot_rom_mapped || (page << 8) >= boot_rom_size || page == (CARTRIDGE_HEADER >> 8) )
+        return NULL;
+
+    return boot_rom + (page << 8);
+}
+
+void map_boot_rom_pages ( void )
+{
+    unsigned int page;
+
+    for ( page = 0; page < (CGB_BOOT_ROM_SIZE >> 8); page++ )
+        map_page(page);
+}
+
+/* Map the boot ROM, from boot_filename or the built-in DMG one, over the
+ * cartridge and start the CPU in it */
+void enable_bootROM ( char *boot_filename )
+{
+    FILE *fp;
+
+    if ( boot_filename )
+    {
+        if ( !(fp = fopen(boot_filename, "rb")) )
+        {
+            perror("fopen");
+            exit(EXIT_FAILURE);
+        }
+
+        boot_rom_size = fread(boot_rom, 1, CGB_BOOT_ROM_SIZE, fp);
+        if ( fgetc(fp) != EOF )
+            boot_rom_size = 0;
+        fclose(fp);
+
+        if ( boot_rom_size != DMG_BOOT_ROM_SIZE && boot_rom_size != CGB_BOOT_ROM_SIZE )
+        {
+            fprintf(stderr, "%s: not a DMG or CGB boot ROM\n", boot_filename);
+            exit(EXIT_FAILURE);
+        }
+    }
+    else
+    {
+        memcpy(boot_rom, gb_boot_rom, DMG_BOOT_ROM_SIZE);
+        boot_rom_size = DMG_BOOT_ROM_SIZE;
+    }
+
+    boot_rom_mapped = 1;
+    map_boot_rom_pages();
+
+    /* Power-on state; the boot ROM turns the LCD on itself */
+    ime = 0;
+    set_mem8(INTERRUPT_ENABLE, 0x00);
+    IO_REG(LCDC) = 0x00;
+    SET_AF(0x0000);
+    SET_BC(0x0000);
+    SET_DE(0x0000);
+    SET_HL(0x0000);
+    sp = 0x0000;
+    pc = 0x0000;
 }
 
+/* Writing BOOT unmaps the boot ROM for good.  Code cached from it is keyed
+ * like cartridge bank 0, so the caches are flushed along with the overlay.
+ * This is a mapping change, not the game rewriting its code, so it must not
+ * count towards leaving pages to the interpreter. */
 void disable_bootROM ( void )
 {
-    memcpy(mem_base, tmp_storage, 256);
+    if ( !boot_rom_mapped )
+        return;
+
+    boot_rom_mapped = 0;
+    map_boot_rom_pages();
 
+    jit_flush();
+    block_flush();
+}
+
+/* Start from the state the boot ROM leaves behind, without running it */
+void skip_bootROM ( void )
+{
     /* Initialize CPU and memory state */
-    SET_AF(0x10b0);
-    SET_BC(0x0013);
-    SET_DE(0x00d8);
-    SET_HL(0x014d);
+    if ( cgb_mode )
+    {
+        SET_AF(0x1180);
+        SET_BC(0x0000);
+        SET_DE(0xff56);
+        SET_HL(0x000d);
+    }
+    else
+    {
+        SET_AF(0x01b0);
+        SET_BC(0x0013);
+        SET_DE(0x00d8);
+        SET_HL(0x014d);
+    }
+    pc = CARTRIDGE_HEADER;
     sp = 0xfffe;
     set_mem8(TIMA, 0x00);
     set_mem8(TMA,  0x00);
     set_mem8(TAC,  0x00);
+    set_mem8(NR52, 0xf1);
     set_mem8(NR10, 0x80);
     set_mem8(NR11, 0xbf);
     set_mem8(NR12, 0xf3);
@@ -63,7 +158,6 @@ void disable_bootROM ( void )
     set_mem8(NR44, 0xbf);
     set_mem8(NR50, 0x77);
     set_mem8(NR51, 0xf3);
-    set_mem8(NR52, 0xf1);
     set_mem8(LCDC, 0x91);
     set_mem8(SCY,  0x00);
     set_mem8(SCX,  0x00);
@@ -78,7 +172,8 @@ void disable_bootROM ( void )
 
 void init_rom ( char *rom_filename )
 {
-    int fd, rom_size;
+    int fd;
+    off_t rom_size;
 
     if ( (fd = open(rom_filename, O_RDONLY)) < 0 )
     {
@@ -87,10 +182,26 @@ void init_rom ( char *rom_filename )
     }
 
     rom_size = lseek(fd, 0, SEEK_END);
-    lseek(fd, 0, SEEK_SET);
 
-    read(fd, mem_base, ROM_BANK_N);
+    /* Reserve a power of two of at least two banks, so bank numbers can be
+     * masked and a short file reads as zeros past its end, then map the
+     * file over the start of it */
+    for ( rom_banks = 2; (off_t)rom_banks * ROM_BANK_SIZE < rom_size; rom_banks <<= 1 )
+        ;
+
+    rom_data = (char *)mmap(NULL, rom_banks * ROM_BANK_SIZE, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if ( rom_data == MAP_FAILED ||
+         mmap(rom_data, rom_size, PROT_READ, MAP_PRIVATE|MAP_FIXED, fd, 0) == MAP_FAILED )
+    {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    close(fd);
+
+    init_cgb();
+    init_mbc();
+    init_save(rom_filename);
 
-    enable_bootROM();
-    disable_bootROM();
+    skip_bootROM();
 }
@@ -1,5 +1,20 @@
 #include "common.h"
 
 void init_rom(char *rom_filename);
-void enable_bootROM(void);
+char *boot_rom_page(unsigned int page);
+void enable_bootROM(char *boot_filename);
 void disable_bootROM(void);
+void skip_bootROM(void);
+
+/*
+ * Boot ROM.  While mapped it overlays the start of the cartridge in the page
+ * table; init_rom() starts from the state it leaves behind instead, unless
+ * it is asked to run.
+ */
+
+#define DMG_BOOT_ROM_SIZE 0x100
+#define CGB_BOOT_ROM_SIZE 0x900
+
+char boot_rom[CGB_BOOT_ROM_SIZE];
+unsigned int boot_rom_size;
+char boot_rom_mapped;
@@ -0,0 +1,75 @@
+#include "common.h"
+#include "cpu.h"
+#include "mem.h"
+#include "interrupt.h"
+#include "video.h"
+#include "timer.h"
+#include "dma.h"
+#include "sched.h"
+#include "jit.h"
+#include "block.h"
+#include "save.h"
+#include "watch.h"
+#include "run.h"
+
+/* Cycles the CPU can run before the next scheduled event */
+unsigned int cycles_to_event ( void )
+{
+    /* A pending interrupt is taken after the next instruction */
+    if ( ime && irq_pending )
+        return 0;
+
+    return event_cycles_left();
+}
+
+/* Run the CPU for up to budget cycles, through whichever of the JIT, the
+ * block cache or the interpreter takes pc.  Code fetched while OAM DMA
+ * locks the bus, or on a page with a breakpoint, is never cached. */
+void run_cpu ( unsigned int budget )
+{
+    if ( halt )
+        exec_halt(budget);
+    else if ( dma_active || (!jit_exec(budget) && !block_exec(budget)) )
+    {
+        if ( break_pages[pc >> 8] )
+            check_breakpoint();
+        exec_instruction();
+    }
+}
+
+/*
+ * Run until total_cpu_cycles reaches deadline.  Nothing but the CPU can
+ * change state before the next scheduled event, so instructions run back
+ * to back until then and interrupts and events are only serviced once per
+ * event, or after an op that wrote memory or changed ime/halt.
+ */
+void run_until ( unsigned int deadline )
+{
+    unsigned int budget, elapsed;
+
+    while ( (int)(deadline - total_cpu_cycles) > 0 )
+    {
+        /* Stop at the deadline even when no event falls before it */
+        budget = cycles_to_event();
+        if ( budget > deadline - total_cpu_cycles )
+            budget = deadline - total_cpu_cycles;
+        elapsed = 0;
+        cpu_sync = 0;
+
+        do
+        {
+            run_cpu(budget - elapsed);
+            elapsed += cpu_cycles;
+        } while ( elapsed < budget && !cpu_sync );
+
+        cpu_cycles = elapsed;
+        check_interrupts();
+        run_events();
+    }
+}
+
+void run_frame ( void )
+{
+    run_until(total_cpu_cycles + FRAME_CYCLES);
+    save_frame();
+}
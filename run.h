@@ -0,0 +1,6 @@
+unsigned int cycles_to_event(void);
+void run_until(unsigned int deadline);
+void run_frame(void);
+
+/* Cycles in one 154-line video frame */
+#define FRAME_CYCLES 70224
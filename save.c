@@ -0,0 +1,202 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "common.h"
+#include "mem.h"
+#include "mbc.h"
+#include "save.h"
+
+char save_enabled;
+char *save_filename;
+char *save_tmp_filename;
+unsigned int save_size;
+
+unsigned char save_dirty[0x200];
+char save_pending;
+
+unsigned int save_frames;
+
+/* Snapshot handed to the writer thread, and whether it is still writing it */
+char *save_buffer;
+char save_queued;
+pthread_t save_thread;
+pthread_mutex_t save_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t save_cond = PTHREAD_COND_INITIALIZER;
+
+/* Cartridge RAM pages are only mapped writable once dirty, so the first
+ * write after each flush is seen */
+int save_page_writable ( char *page )
+{
+    return !save_enabled || save_dirty[(page - cart_ram) >> 8];
+}
+
+/* Called on slow-path writes to cartridge RAM at addr */
+void save_touch ( unsigned short addr )
+{
+    unsigned int ram_page = (mem_page[addr >> 8] - cart_ram) >> 8;
+
+    if ( !save_enabled || save_dirty[ram_page] )
+        return;
+
+    save_dirty[ram_page] = 1;
+    save_pending = 1;
+    map_page(addr >> 8);
+}
+
+/* Write a snapshot to the temporary file and rename it over the save */
+void save_write ( char *buffer )
+{
+    unsigned int done = 0;
+    int fd, n;
+
+    if ( (fd = open(save_tmp_filename, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0 )
+    {
+        perror(save_tmp_filename);
+        return;
+    }
+
+    while ( done < save_size )
+    {
+        if ( (n = write(fd, buffer + done, save_size - done)) < 0 )
+        {
+            perror(save_tmp_filename);
+            close(fd);
+            return;
+        }
+        done += n;
+    }
+
+    if ( fsync(fd) < 0 || close(fd) < 0 || rename(save_tmp_filename, save_filename) < 0 )
+        perror(save_filename);
+}
+
+void *save_writer ( void *arg )
+{
+    pthread_mutex_lock(&save_lock);
+    while ( 1 )
+    {
+        while ( !save_queued )
+            pthread_cond_wait(&save_cond, &save_lock);
+
+        pthread_mutex_unlock(&save_lock);
+        save_write(save_buffer);
+        pthread_mutex_lock(&save_lock);
+
+        save_queued = 0;
+        pthread_cond_broadcast(&save_cond);
+    }
+
+    return NULL;
+}
+
+/* Copy the RAM for writing and start tracking writes afresh */
+void save_snapshot ( void )
+{
+    memcpy(save_buffer, cart_ram, cart_ram_size);
+    if ( mbc_rtc )
+        rtc_save((unsigned char *)save_buffer + cart_ram_size);
+    memset(save_dirty, 0, sizeof(save_dirty));
+    save_pending = 0;
+    map_ram_pages();
+}
+
+/* Hand a dirty RAM to the writer thread.  If it is still busy with the
+ * last snapshot, try again later rather than wait. */
+void save_flush ( void )
+{
+    if ( !save_pending || pthread_mutex_trylock(&save_lock) != 0 )
+        return;
+
+    if ( !save_queued )
+    {
+        save_snapshot();
+        save_queued = 1;
+        pthread_cond_signal(&save_cond);
+    }
+    pthread_mutex_unlock(&save_lock);
+}
+
+/* Called once per frame */
+void save_frame ( void )
+{
+    if ( save_enabled && ++save_frames >= SAVE_FLUSH_FRAMES )
+    {
+        save_frames = 0;
+        save_flush();
+
+        /* Keep the clock's cycle count from wrapping between reads */
+        if ( mbc_rtc )
+            rtc_sync();
+    }
+}
+
+/* Write out anything still dirty before exiting */
+void exit_save ( void )
+{
+    if ( !save_enabled )
+        return;
+
+    pthread_mutex_lock(&save_lock);
+    while ( save_queued )
+        pthread_cond_wait(&save_cond, &save_lock);
+
+    if ( save_pending )
+    {
+        save_snapshot();
+        save_write(save_buffer);
+    }
+    pthread_mutex_unlock(&save_lock);
+}
+
+/* Back battery RAM, and the clock, by the .sav file next to the ROM */
+void init_save ( char *rom_filename )
+{
+    char *dot = strrchr(rom_filename, '.');
+    size_t len = dot && !strchr(dot, '/') ? (size_t)(dot - rom_filename) : strlen(rom_filename);
+    unsigned char rtc[RTC_SAVE_SIZE];
+    struct stat st;
+    int fd;
+
+    if ( !mbc_battery || (cart_ram_size == 0 && !mbc_rtc) )
+        return;
+
+    save_size = cart_ram_size + (mbc_rtc ? RTC_SAVE_SIZE : 0);
+    save_filename = malloc(len + 5);
+    save_tmp_filename = malloc(len + 9);
+    save_buffer = malloc(save_size);
+    if ( save_filename == NULL || save_tmp_filename == NULL || save_buffer == NULL )
+    {
+        perror("init_save");
+        exit(EXIT_FAILURE);
+    }
+    sprintf(save_filename, "%.*s.sav", (int)len, rom_filename);
+    sprintf(save_tmp_filename, "%s.tmp", save_filename);
+
+    /* Map an existing save over the start of the RAM, and read back the
+     * clock saved after it */
+    if ( (fd = open(save_filename, O_RDONLY)) >= 0 )
+    {
+        if ( fstat(fd, &st) == 0 && st.st_size > 0 && cart_ram_size &&
+             mmap(cart_ram, st.st_size < cart_ram_size ? st.st_size : cart_ram_size,
+                  PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, fd, 0) == MAP_FAILED )
+        {
+            perror(save_filename);
+            exit(EXIT_FAILURE);
+        }
+        if ( mbc_rtc && pread(fd, rtc, RTC_SAVE_SIZE, cart_ram_size) == RTC_SAVE_SIZE )
+            rtc_load(rtc);
+        close(fd);
+    }
+
+    if ( pthread_create(&save_thread, NULL, save_writer, NULL) != 0 )
+    {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+
+    save_enabled = 1;
+    map_ram_pages();
+}
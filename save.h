@@ -0,0 +1,29 @@
+void init_save(char *rom_filename);
+int save_page_writable(char *page);
+void save_touch(unsigned short addr);
+void save_frame(void);
+void save_flush(void);
+void exit_save(void);
+
+/*
+ * Battery-backed cartridge RAM.  The .sav file is mapped privately as the
+ * cartridge RAM, so it loads without a copy and is never written in place.
+ * Pages start out mapped read-only; the first write to one marks it dirty
+ * and maps it writable.  Every SAVE_FLUSH_FRAMES frames a dirty RAM is
+ * snapshotted and handed to a writer thread, which writes a temporary file
+ * and renames it over the .sav, so a killed process leaves the old save
+ * intact.  An MBC3 clock is saved after the RAM.
+ */
+
+#define SAVE_FLUSH_FRAMES 60
+
+char save_enabled;
+char *save_filename;
+char *save_tmp_filename;
+unsigned int save_size;   /* RAM, then the MBC3 clock if there is one */
+
+/* Dirty flags per 256-byte page of cartridge RAM, and whether any is set */
+unsigned char save_dirty[0x200];
+char save_pending;
+
+unsigned int save_frames;
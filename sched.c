@@ -0,0 +1,76 @@
+#include "common.h"
+#include "cpu.h"
+#include "video.h"
+#include "timer.h"
+#include "serial.h"
+#include "dma.h"
+#include "sched.h"
+
+struct event event_queue[EVENTS];
+unsigned int event_count;
+
+const event_handler event_handlers[EVENTS] =
+{
+    [EVENT_VIDEO]  = video_event,
+    [EVENT_TIMA]   = tima_event,
+    [EVENT_SERIAL] = serial_event,
+    [EVENT_DMA]    = dma_event,
+};
+
+void unschedule ( unsigned char event )
+{
+    unsigned int i;
+
+    for ( i = 0; i < event_count; i++ )
+    {
+        if ( event_queue[i].id == event )
+        {
+            memmove(&event_queue[i], &event_queue[i + 1], (event_count - i - 1) * sizeof(struct event));
+            event_count--;
+            return;
+        }
+    }
+}
+
+/* Set event's deadline, replacing any it had.  Deadlines are compared
+ * relative to now, so the cycle counter can wrap. */
+void schedule ( unsigned char event, unsigned int when )
+{
+    int left = when - total_cpu_cycles;
+    unsigned int i;
+
+    unschedule(event);
+
+    for ( i = event_count; i > 0 && (int)(event_queue[i - 1].when - total_cpu_cycles) > left; i-- )
+        event_queue[i] = event_queue[i - 1];
+
+    event_queue[i].when = when;
+    event_queue[i].id = event;
+    event_count++;
+}
+
+/* Cycles until the next event is due */
+unsigned int event_cycles_left ( void )
+{
+    int left;
+
+    if ( event_count == 0 )
+        return ~0u;
+
+    left = event_queue[0].when - total_cpu_cycles;
+    return left > 0 ? left : 0;
+}
+
+/* Run every event that is due, in deadline order */
+void run_events ( void )
+{
+    struct event next;
+
+    while ( event_count && (int)(total_cpu_cycles - event_queue[0].when) >= 0 )
+    {
+        next = event_queue[0];
+        memmove(&event_queue[0], &event_queue[1], (event_count - 1) * sizeof(struct event));
+        event_count--;
+        event_handlers[next.id](next.when);
+    }
+}
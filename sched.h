@@ -0,0 +1,33 @@
+void schedule(unsigned char event, unsigned int when);
+void unschedule(unsigned char event);
+unsigned int event_cycles_left(void);
+void run_events(void);
+
+/*
+ * Event scheduler.  Each piece of hardware that changes state on its own
+ * keeps at most one pending deadline here, in total_cpu_cycles.  The queue
+ * is a small array sorted by deadline, so the CPU only has to look at the
+ * front to know how long it can run, and hardware only does work when one
+ * of its events is due.
+ */
+
+#define EVENT_VIDEO  0 /* LCD mode change */
+#define EVENT_TIMA   1 /* TIMA overflow */
+#define EVENT_SERIAL 2 /* Serial transfer done */
+#define EVENT_DMA    3 /* OAM DMA releases the bus */
+#define EVENTS       4
+
+/* Called with the cycle the event was due, which may have passed by the
+ * length of an instruction */
+typedef void (*event_handler)(unsigned int when);
+
+extern const event_handler event_handlers[EVENTS];
+
+struct event
+{
+    unsigned int when;
+    unsigned char id;
+};
+
+struct event event_queue[EVENTS];
+unsigned int event_count;
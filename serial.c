@@ -1,6 +1,29 @@
-unsigned char serial_transfer_data;
-unsigned char serial_shift_clock;
-unsigned char serial_transfer_start_flag;
+#include "common.h"
+#include "cpu.h"
+#include "mem.h"
+#include "interrupt.h"
+#include "io_regs.h"
+#include "serial.h"
+#include "sched.h"
+
+/* A transfer clocked by us ends after 8 bits; with no cable connected the
+ * byte shifted in is all ones */
+void serial_event ( unsigned int when )
+{
+    IO_REG(SB) = 0xff;
+    IO_REG(SC) &= ~SC_START;
+    INTERRUPT(SERIAL);
+}
+
+/* Called when SC is written.  A transfer on the other side's clock never
+ * ends, as there is no other side. */
+void start_serial ( void )
+{
+    if ( (IO_REG(SC) & (SC_START | SC_INTERNAL)) == (SC_START | SC_INTERNAL) )
+        schedule(EVENT_SERIAL, total_cpu_cycles + SERIAL_CYCLES);
+    else
+        unschedule(EVENT_SERIAL);
+}
 
 void init_serial ( void )
 {
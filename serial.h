@@ -1,5 +1,10 @@
 void init_serial(void);
+void serial_event(unsigned int when);
+void start_serial(void);
 
-unsigned char serial_transfer_data;
-unsigned char serial_shift_clock;
-unsigned char serial_transfer_start_flag;
+/* SB and SC are raw bytes in the I/O page */
+
+#define SC_START    0x80
+#define SC_INTERNAL 0x01
+
+#define SERIAL_CYCLES 4096 /* 8 bits at 8192 Hz */
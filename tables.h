@@ -0,0 +1,29 @@
+/*
+ * ALU lookup tables, generated at build time by mktables.
+ *
+ * alu_add_table and alu_sub_table hold the flags for x + y + carry and
+ * x - y - carry, indexed by ALU_INDEX(carry, x, y).  inc_flags_table and
+ * dec_flags_table hold Z/N/H for incrementing or decrementing a value.
+ * daa_table and shift_table hold (result << 8) | flags.
+ */
+
+extern const unsigned char alu_add_table[2 * 256 * 256];
+extern const unsigned char alu_sub_table[2 * 256 * 256];
+extern const unsigned char inc_flags_table[256];
+extern const unsigned char dec_flags_table[256];
+extern const unsigned short daa_table[8 * 256];
+extern const unsigned short shift_table[8 * 2 * 256];
+
+#define ALU_INDEX(carry, x, y)    (((carry) << 16) | ((x) << 8) | (y))
+#define DAA_INDEX(flags, x)       ((((flags) & 0x70) << 4) | (x))
+#define SHIFT_INDEX(op, carry, x) (((op) << 9) | ((carry) << 8) | (x))
+
+/* Rotate/shift ops, numbered as in bits 3-5 of the CB opcode */
+#define SHIFT_RLC  0
+#define SHIFT_RRC  1
+#define SHIFT_RL   2
+#define SHIFT_RR   3
+#define SHIFT_SLA  4
+#define SHIFT_SRA  5
+#define SHIFT_SWAP 6
+#define SHIFT_SRL  7
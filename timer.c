@@ -2,71 +2,103 @@
 #include "cpu.h"
 #include "mem.h"
 #include "interrupt.h"
+#include "io_regs.h"
+#include "timer.h"
+#include "sched.h"
 
-unsigned char div_reg;
-unsigned char timer_enabled;
-unsigned char timer_input_clock_select;
-unsigned short timer_counter;
-unsigned char timer_modulo;
-unsigned char timer_enabled;
-unsigned char timer_input_clock_select;
-unsigned int timer_cycles;
-unsigned int div_cycles;
-
-void increment_timer ( void )
+unsigned int div_base;
+unsigned int tima_ticks;
+unsigned char tima_start;
+
+/* log2 of the cycles per TIMA tick for each TAC clock select */
+const unsigned char timer_shift[4] = { 10, 4, 6, 8 };
+
+/* Falling edges of the TAC-selected divider bit since DIV was reset */
+unsigned int timer_ticks ( unsigned int when )
 {
-    if ( timer_counter > 0xff )
-    {
-        INTERRUPT(TIMER);
-        timer_counter = timer_modulo & 0xff;
-    }
-    else
-    {
-        timer_counter++;
-    }
+    return (when - div_base) >> timer_shift[IO_REG(TAC) & TAC_CLOCK];
 }
 
-void update_TIMA ( void )
+unsigned char tima_count ( unsigned int when )
 {
-    if ( (timer_input_clock_select == 0) && (timer_cycles >= 1024) )
-    {
-        timer_cycles -= 1024;
-        increment_timer();
-    }
-    else if ( (timer_input_clock_select == 1) && (timer_cycles >= 16) )
-    {
-        timer_cycles -= 16;
-        increment_timer();
-    }
-    else if ( (timer_input_clock_select == 2) && (timer_cycles >= 64) )
-    {
-        timer_cycles -= 64;
-        increment_timer();
-    }
-    else if ( (timer_input_clock_select == 3) && (timer_cycles >= 256) )
-    {
-        timer_cycles -= 256;
-        increment_timer();
-    }
+    if ( !(IO_REG(TAC) & TAC_ENABLE) )
+        return tima_start;
+
+    return tima_start + timer_ticks(when) - tima_ticks;
 }
 
-void update_DIV ( void )
+/* Count TIMA on from value at when, and schedule its overflow */
+void rebase_timer ( unsigned int when, unsigned char value )
 {
-    div_cycles += cpu_cycles;
-    if ( div_cycles >= 256 )
+    unsigned int clock = IO_REG(TAC) & TAC_CLOCK;
+
+    tima_start = value;
+    if ( !(IO_REG(TAC) & TAC_ENABLE) )
     {
-        div_cycles -= 256;
-        div_reg++;
+        unschedule(EVENT_TIMA);
+        return;
     }
+
+    tima_ticks = timer_ticks(when);
+    schedule(EVENT_TIMA, div_base + ((tima_ticks + 0x100 - value) << timer_shift[clock]));
+}
+
+/* TIMA reloads from TMA when it overflows */
+void tima_event ( unsigned int when )
+{
+    INTERRUPT(TIMER);
+    rebase_timer(when, IO_REG(TMA));
+}
+
+unsigned char timer_DIV ( void )
+{
+    unsigned int now = CPU_TIME();
+
+    read_until(now + 0x100 - ((now - div_base) & 0xff));
+    return (now - div_base) >> 8;
+}
+
+unsigned char timer_TIMA ( void )
+{
+    unsigned int now = CPU_TIME();
+    unsigned int shift = timer_shift[IO_REG(TAC) & TAC_CLOCK];
+
+    /* A stopped timer only changes when written */
+    if ( IO_REG(TAC) & TAC_ENABLE )
+        read_until(div_base + ((timer_ticks(now) + 1) << shift));
+    return tima_count(now);
 }
 
-void cycle_timer ( void )
+/* Called when TIMA is written */
+void restart_timer ( unsigned char value )
 {
-    update_TIMA();
-    update_DIV();
+    rebase_timer(CPU_TIME(), value);
+}
+
+/* Called when TAC is written.  TIMA keeps its count across a change of
+ * clock or enable. */
+void set_TAC ( unsigned char value )
+{
+    unsigned int now = CPU_TIME();
+    unsigned char tima = tima_count(now);
+
+    IO_REG(TAC) = value;
+    rebase_timer(now, tima);
+}
+
+/* Called when DIV is written.  The TIMA clock restarts with the divider,
+ * from the same count. */
+void reset_div ( void )
+{
+    unsigned int now = CPU_TIME();
+    unsigned char tima = tima_count(now);
+
+    div_base = now;
+    rebase_timer(now, tima);
 }
 
 void init_timer ( void )
 {
-    div_reg = 0;
+    div_base = CPU_TIME();
+    rebase_timer(div_base, 0);
 }
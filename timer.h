@@ -1,9 +1,24 @@
 void init_timer(void);
-void cycle_timer(void);
+void tima_event(unsigned int when);
+unsigned char timer_DIV(void);
+unsigned char timer_TIMA(void);
+void restart_timer(unsigned char value);
+void set_TAC(unsigned char value);
+void reset_div(void);
 
-unsigned char div_reg;
-unsigned char timer_enabled;
-unsigned char timer_input_clock_select;
-unsigned char timer_counter;
-unsigned char timer_modulo;
-unsigned char timer_enabled;
+/*
+ * DIV and TIMA are not stepped: both are worked out from total_cpu_cycles
+ * when read.  DIV is the top byte of a 16-bit divider counting up from
+ * div_base, and TIMA counts ticks of the divider bit TAC selects from
+ * tima_start, which it held at tick tima_ticks.  Writes to DIV, TIMA and TAC
+ * rebase the count, and the only event is the next TIMA overflow.  TMA is a
+ * plain byte, read when the overflow reloads TIMA from it.
+ */
+unsigned int div_base;
+unsigned int tima_ticks;
+unsigned char tima_start;
+
+extern const unsigned char timer_shift[4];
+
+#define TAC_CLOCK  0x3
+#define TAC_ENABLE 0x4
@@ -0,0 +1,90 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include "common.h"
+#include "cpu.h"
+#include "mem.h"
+#include "trace.h"
+
+char trace_enabled;
+struct trace_buffer trace;
+
+/* Record the instruction at pc before it executes */
+void trace_instruction ( void )
+{
+    struct trace_record *rec = &trace.records[trace.head++ & (TRACE_ENTRIES - 1)];
+
+    rec->cycles = total_cpu_cycles;
+    rec->pc = pc;
+    rec->sp = sp;
+    rec->op[0] = (unsigned char)peek_mem8(pc);
+    rec->op[1] = (unsigned char)peek_mem8(pc + 1);
+    rec->op[2] = (unsigned char)peek_mem8(pc + 2);
+    rec->a = a;
+    rec->flags = GET_FLAGS();
+    rec->b = b;
+    rec->c = c;
+    rec->d = d;
+    rec->e = e;
+    rec->h = h;
+    rec->l = l;
+}
+
+/* Write the ring out oldest-first */
+void dump_trace ( void )
+{
+    struct trace_header header;
+    unsigned int count, first, tail;
+
+    if ( trace.records == NULL )
+        return;
+
+    count = (trace.head < TRACE_ENTRIES) ? trace.head : TRACE_ENTRIES;
+    first = (trace.head - count) & (TRACE_ENTRIES - 1);
+    tail = TRACE_ENTRIES - first;
+    if ( tail > count )
+        tail = count;
+
+    header.magic = TRACE_MAGIC;
+    header.record_size = sizeof(struct trace_record);
+    header.count = count;
+
+    if ( lseek(trace.fd, 0, SEEK_SET) < 0 ||
+         write(trace.fd, &header, sizeof(header)) < 0 ||
+         write(trace.fd, &trace.records[first], tail * sizeof(struct trace_record)) < 0 ||
+         write(trace.fd, trace.records, (count - tail) * sizeof(struct trace_record)) < 0 )
+        return;
+
+    ftruncate(trace.fd, sizeof(header) + count * sizeof(struct trace_record));
+}
+
+/* SIGUSR1 toggles recording.  SIGINT and SIGTERM just leave the main loop,
+ * and the ring is written out at exit. */
+void trace_signal ( int sig )
+{
+    trace_enabled = !trace_enabled;
+}
+
+void init_trace ( char *trace_filename )
+{
+    if ( (trace.fd = open(trace_filename, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0 )
+    {
+        perror("open");
+        exit(EXIT_FAILURE);
+    }
+
+    trace.records = calloc(TRACE_ENTRIES, sizeof(struct trace_record));
+    if ( trace.records == NULL )
+    {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    trace.head = 0;
+    trace_enabled = 1;
+
+    signal(SIGUSR1, trace_signal);
+    atexit(dump_trace);
+}
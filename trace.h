@@ -0,0 +1,43 @@
+void init_trace(char *trace_filename);
+void trace_instruction(void);
+void dump_trace(void);
+
+/*
+ * Flight recorder.  While tracing is enabled every instruction is stored as
+ * a fixed-size record in a ring buffer; nothing is formatted at run time.
+ * The ring is written out on exit or on an invalid opcode and turned back
+ * into disassembly offline by tracefmt.
+ */
+
+#define TRACE_MAGIC   0x52544443 /* "CDTR" */
+#define TRACE_ENTRIES 0x10000    /* Must be a power of two */
+
+struct trace_record
+{
+    unsigned int cycles;
+    unsigned short pc, sp;
+    unsigned char op[3];
+    unsigned char a, flags, b, c, d, e, h, l;
+};
+
+struct trace_header
+{
+    unsigned int magic;
+    unsigned int record_size;
+    unsigned int count;
+};
+
+struct trace_buffer
+{
+    struct trace_record *records;
+    unsigned int head;
+    int fd;
+};
+
+char trace_enabled;
+struct trace_buffer trace;
+
+#define TRACE() do {           \
+    if ( trace_enabled )       \
+        trace_instruction();   \
+} while (0)
@@ -0,0 +1,425 @@
+#include <unistd.h>
+#include "common.h"
+#include "trace.h"
+
+/*
+ * tracefmt: turn a binary trace written by cardamine -t back into the
+ * disassembly listing the interpreter used to print while running.
+ */
+
+/* Mnemonics for the base opcodes; NULL marks an invalid opcode */
+const char *mnemonics[256] = {
+    /* 00 */ "nop",
+    /* 01 */ "ld bc, 0x%hx",
+    /* 02 */ "ld (bc), a",
+    /* 03 */ "inc bc",
+    /* 04 */ "inc b",
+    /* 05 */ "dec b",
+    /* 06 */ "ld b, 0x%hhx",
+    /* 07 */ "rlca",
+    /* 08 */ "ld (0x%hx), sp",
+    /* 09 */ "add hl, bc",
+    /* 0a */ "ld a, (bc)",
+    /* 0b */ "dec bc",
+    /* 0c */ "inc c",
+    /* 0d */ "dec c",
+    /* 0e */ "ld c, 0x%hhx",
+    /* 0f */ "rrca",
+    /* 10 */ "stop",
+    /* 11 */ "ld de, 0x%hx",
+    /* 12 */ "ld (de), a",
+    /* 13 */ "inc de",
+    /* 14 */ "inc d",
+    /* 15 */ "dec d",
+    /* 16 */ "ld d, 0x%hhx",
+    /* 17 */ "rla",
+    /* 18 */ "jr 0x%hhx",
+    /* 19 */ "add hl, de",
+    /* 1a */ "ld a, (de)",
+    /* 1b */ "dec de",
+    /* 1c */ "inc e",
+    /* 1d */ "dec e",
+    /* 1e */ "ld e, 0x%hhx",
+    /* 1f */ "rra",
+    /* 20 */ "jr nz, 0x%hhx",
+    /* 21 */ "ld hl, 0x%hx",
+    /* 22 */ "ldi (hl), a",
+    /* 23 */ "inc hl",
+    /* 24 */ "inc h",
+    /* 25 */ "dec h",
+    /* 26 */ "ld h, 0x%hhx",
+    /* 27 */ "daa",
+    /* 28 */ "jr z, 0x%hhx",
+    /* 29 */ "add hl, hl",
+    /* 2a */ "ldi a, (hl)",
+    /* 2b */ "dec hl",
+    /* 2c */ "inc l",
+    /* 2d */ "dec l",
+    /* 2e */ "ld l, 0x%hhx",
+    /* 2f */ "cpl",
+    /* 30 */ "jr nc, 0x%hhx",
+    /* 31 */ "ld sp, 0x%hx",
+    /* 32 */ "ldd (hl), a",
+    /* 33 */ "inc sp",
+    /* 34 */ "inc (hl)",
+    /* 35 */ "dec (hl)",
+    /* 36 */ "ld (hl), 0x%hhx",
+    /* 37 */ "scf",
+    /* 38 */ "jr c, 0x%hhx",
+    /* 39 */ "add hl, sp",
+    /* 3a */ "ldd a, (hl)",
+    /* 3b */ "dec sp",
+    /* 3c */ "inc a",
+    /* 3d */ "dec a",
+    /* 3e */ "ld a, 0x%hhx",
+    /* 3f */ "ccf",
+    /* 40 */ "ld b, b",
+    /* 41 */ "ld b, c",
+    /* 42 */ "ld b, d",
+    /* 43 */ "ld b, e",
+    /* 44 */ "ld b, h",
+    /* 45 */ "ld b, l",
+    /* 46 */ "ld b, (hl)",
+    /* 47 */ "ld b, a",
+    /* 48 */ "ld c, b",
+    /* 49 */ "ld c, c",
+    /* 4a */ "ld c, d",
+    /* 4b */ "ld c, e",
+    /* 4c */ "ld c, h",
+    /* 4d */ "ld c, l",
+    /* 4e */ "ld c, (hl)",
+    /* 4f */ "ld c, a",
+    /* 50 */ "ld d, b",
+    /* 51 */ "ld d, c",
+    /* 52 */ "ld d, d",
+    /* 53 */ "ld d, e",
+    /* 54 */ "ld d, h",
+    /* 55 */ "ld d, l",
+    /* 56 */ "ld d, (hl)",
+    /* 57 */ "ld d, a",
+    /* 58 */ "ld e, b",
+    /* 59 */ "ld e, c",
+    /* 5a */ "ld e, d",
+    /* 5b */ "ld e, e",
+    /* 5c */ "ld e, h",
+    /* 5d */ "ld e, l",
+    /* 5e */ "ld e, (hl)",
+    /* 5f */ "ld e, a",
+    /* 60 */ "ld h, b",
+    /* 61 */ "ld h, c",
+    /* 62 */ "ld h, d",
+    /* 63 */ "ld h, e",
+    /* 64 */ "ld h, h",
+    /* 65 */ "ld h, l",
+    /* 66 */ "ld h, (hl)",
+    /* 67 */ "ld h, a",
+    /* 68 */ "ld l, b",
+    /* 69 */ "ld l, c",
+    /* 6a */ "ld l, d",
+    /* 6b */ "ld l, e",
+    /* 6c */ "ld l, h",
+    /* 6d */ "ld l, l",
+    /* 6e */ "ld l, (hl)",
+    /* 6f */ "ld l, a",
+    /* 70 */ "ld (hl), b",
+    /* 71 */ "ld (hl), c",
+    /* 72 */ "ld (hl), d",
+    /* 73 */ "ld (hl), e",
+    /* 74 */ "ld (hl), h",
+    /* 75 */ "ld (hl), l",
+    /* 76 */ "halt",
+    /* 77 */ "ld (hl), a",
+    /* 78 */ "ld a, b",
+    /* 79 */ "ld a, c",
+    /* 7a */ "ld a, d",
+    /* 7b */ "ld a, e",
+    /* 7c */ "ld a, h",
+    /* 7d */ "ld a, l",
+    /* 7e */ "ld a, (hl)",
+    /* 7f */ "ld a, a",
+    /* 80 */ "add a, b",
+    /* 81 */ "add a, c",
+    /* 82 */ "add a, d",
+    /* 83 */ "add a, e",
+    /* 84 */ "add a, h",
+    /* 85 */ "add a, l",
+    /* 86 */ "add a, (hl)",
+    /* 87 */ "add a, a",
+    /* 88 */ "adc a, b",
+    /* 89 */ "adc a, c",
+    /* 8a */ "adc a, d",
+    /* 8b */ "adc a, e",
+    /* 8c */ "adc a, h",
+    /* 8d */ "adc a, l",
+    /* 8e */ "adc a, (hl)",
+    /* 8f */ "adc a, a",
+    /* 90 */ "sub b",
+    /* 91 */ "sub c",
+    /* 92 */ "sub d",
+    /* 93 */ "sub e",
+    /* 94 */ "sub h",
+    /* 95 */ "sub l",
+    /* 96 */ "sub (hl)",
+    /* 97 */ "sub a",
+    /* 98 */ "sbc a, b",
+    /* 99 */ "sbc a, c",
+    /* 9a */ "sbc a, d",
+    /* 9b */ "sbc a, e",
+    /* 9c */ "sbc a, h",
+    /* 9d */ "sbc a, l",
+    /* 9e */ "sbc a, (hl)",
+    /* 9f */ "sbc a, a",
+    /* a0 */ "and b",
+    /* a1 */ "and c",
+    /* a2 */ "and d",
+    /* a3 */ "and e",
+    /* a4 */ "and h",
+    /* a5 */ "and l",
+    /* a6 */ "and (hl)",
+    /* a7 */ "and a",
+    /* a8 */ "xor b",
+    /* a9 */ "xor c",
+    /* aa */ "xor d",
+    /* ab */ "xor e",
+    /* ac */ "xor h",
+    /* ad */ "xor l",
+    /* ae */ "xor (hl)",
+    /* af */ "xor a",
+    /* b0 */ "or b",
+    /* b1 */ "or c",
+    /* b2 */ "or d",
+    /* b3 */ "or e",
+    /* b4 */ "or h",
+    /* b5 */ "or l",
+    /* b6 */ "or (hl)",
+    /* b7 */ "or a",
+    /* b8 */ "cp b",
+    /* b9 */ "cp c",
+    /* ba */ "cp d",
+    /* bb */ "cp e",
+    /* bc */ "cp h",
+    /* bd */ "cp l",
+    /* be */ "cp (hl)",
+    /* bf */ "cp a",
+    /* c0 */ "ret nz",
+    /* c1 */ "pop bc",
+    /* c2 */ "jp nz, 0x%hx",
+    /* c3 */ "jp 0x%hx",
+    /* c4 */ "call nz, 0x%hx",
+    /* c5 */ "push bc",
+    /* c6 */ "add a, 0x%hhx",
+    /* c7 */ "rst 0x0",
+    /* c8 */ "ret z",
+    /* c9 */ "ret",
+    /* ca */ "jp z, 0x%hx",
+    /* cb */ NULL,
+    /* cc */ "call z, 0x%hx",
+    /* cd */ "call 0x%hx",
+    /* ce */ "adc a, 0x%hhx",
+    /* cf */ "rst 0x8",
+    /* d0 */ "ret nc",
+    /* d1 */ "pop de",
+    /* d2 */ "jp nc, 0x%hx",
+    /* d3 */ NULL,
+    /* d4 */ "call nc, 0x%hx",
+    /* d5 */ "push de",
+    /* d6 */ "sub 0x%hhx",
+    /* d7 */ "rst 0x10",
+    /* d8 */ "ret c",
+    /* d9 */ "reti",
+    /* da */ "jp c, 0x%hx",
+    /* db */ NULL,
+    /* dc */ "call c, 0x%hx",
+    /* dd */ NULL,
+    /* de */ NULL,
+    /* df */ "rst 0x18",
+    /* e0 */ "ld (0xff00+0x%hhx), a",
+    /* e1 */ "pop hl",
+    /* e2 */ "ld (0xff00+c), a",
+    /* e3 */ NULL,
+    /* e4 */ NULL,
+    /* e5 */ "push hl",
+    /* e6 */ "and 0x%hhx",
+    /* e7 */ "rst 0x20",
+    /* e8 */ "add sp, 0x%hhx",
+    /* e9 */ "jp (hl)",
+    /* ea */ "ld (0x%hx), a",
+    /* eb */ NULL,
+    /* ec */ NULL,
+    /* ed */ NULL,
+    /* ee */ "xor 0x%hhx",
+    /* ef */ "rst 0x28",
+    /* f0 */ "ld a, (0xff00+0x%hhx)",
+    /* f1 */ "pop af",
+    /* f2 */ "ld a, (0xff00+c)",
+    /* f3 */ "di",
+    /* f4 */ NULL,
+    /* f5 */ "push af",
+    /* f6 */ "or 0x%hhx",
+    /* f7 */ "rst 0x30",
+    /* f8 */ "ldhl sp, 0x%hhx",
+    /* f9 */ "ld sp, hl",
+    /* fa */ "ld a, (0x%hx)",
+    /* fb */ "ei",
+    /* fc */ NULL,
+    /* fd */ NULL,
+    /* fe */ "cp 0x%hhx (a=%hhx)",
+    /* ff */ "rst 0x38"
+};
+
+/* Mnemonics for CB 0x00-0x3f; BIT/RES/SET are decoded from the opcode */
+const char *cb_mnemonics[64] = {
+    /* 00 */ "rlc b",
+    /* 01 */ "rlc c",
+    /* 02 */ "rlc d",
+    /* 03 */ "rlc e",
+    /* 04 */ "rlc h",
+    /* 05 */ "rlc l",
+    /* 06 */ "rlc (hl)",
+    /* 07 */ "rlc a",
+    /* 08 */ "rrc b",
+    /* 09 */ "rrc c",
+    /* 0a */ "rrc d",
+    /* 0b */ "rrc e",
+    /* 0c */ "rrc h",
+    /* 0d */ "rrc l",
+    /* 0e */ "rrc (hl)",
+    /* 0f */ "rrc a",
+    /* 10 */ "rl b",
+    /* 11 */ "rl c",
+    /* 12 */ "rl d",
+    /* 13 */ "rl e",
+    /* 14 */ "rl h",
+    /* 15 */ "rl l",
+    /* 16 */ "rl (hl)",
+    /* 17 */ "rl a",
+    /* 18 */ "rr b",
+    /* 19 */ "rr c",
+    /* 1a */ "rr d",
+    /* 1b */ "rr e",
+    /* 1c */ "rr h",
+    /* 1d */ "rr l",
+    /* 1e */ "rr (hl)",
+    /* 1f */ "rr a",
+    /* 20 */ "sla b",
+    /* 21 */ "sla c",
+    /* 22 */ "sla d",
+    /* 23 */ "sla e",
+    /* 24 */ "sla h",
+    /* 25 */ "sla l",
+    /* 26 */ "sla (hl)",
+    /* 27 */ "sla a",
+    /* 28 */ "sra b",
+    /* 29 */ "sra c",
+    /* 2a */ "sra d",
+    /* 2b */ "sra e",
+    /* 2c */ "sra h",
+    /* 2d */ "sra l",
+    /* 2e */ "sra (hl)",
+    /* 2f */ "sra a",
+    /* 30 */ "swap b",
+    /* 31 */ "swap c",
+    /* 32 */ "swap d",
+    /* 33 */ "swap e",
+    /* 34 */ "swap h",
+    /* 35 */ "swap l",
+    /* 36 */ "swap (hl)",
+    /* 37 */ "swap a",
+    /* 38 */ "srl b",
+    /* 39 */ "srl c",
+    /* 3a */ "srl d",
+    /* 3b */ "srl e",
+    /* 3c */ "srl h",
+    /* 3d */ "srl l",
+    /* 3e */ "srl (hl)",
+    /* 3f */ "srl a"
+};
+
+const char *cb_bit_ops[4] = { NULL, "bit", "res", "set" };
+const char *cb_regs[8] = { "b", "c", "d", "e", "h", "l", "(hl)", "a" };
+
+void format_record ( struct trace_record *rec, int verbose )
+{
+    char text[64];
+    unsigned char op = rec->op[0];
+
+    if ( op == 0xcb )
+    {
+        unsigned char cb = rec->op[1];
+
+        if ( cb < 0x40 )
+            snprintf(text, sizeof(text), "%s", cb_mnemonics[cb]);
+        else
+            snprintf(text, sizeof(text), "%s %hhu, %s", cb_bit_ops[cb >> 6], (cb >> 3) & 0x7, cb_regs[cb & 0x7]);
+    }
+    else if ( mnemonics[op] == NULL )
+    {
+        snprintf(text, sizeof(text), "(bad: %hhx)", op);
+    }
+    else
+    {
+        const char *fmt = mnemonics[op];
+        unsigned int operand = rec->op[1];
+
+        /* 16-bit immediates are printed with %hx, 8-bit ones with %hhx */
+        if ( strstr(fmt, "%hx") )
+            operand |= rec->op[2] << 8;
+
+        snprintf(text, sizeof(text), fmt, operand, rec->a);
+    }
+
+    if ( verbose )
+        printf("%04hx  %-24s cyc=%u sp=%04hx af=%02hhx%02hhx bc=%02hhx%02hhx de=%02hhx%02hhx hl=%02hhx%02hhx\n",
+               rec->pc, text, rec->cycles, rec->sp, rec->a, rec->flags, rec->b, rec->c, rec->d, rec->e, rec->h, rec->l);
+    else
+        printf("%04hx  %s\n", rec->pc, text);
+}
+
+int main ( int argc, char **argv )
+{
+    struct trace_header header;
+    struct trace_record rec;
+    int verbose = 0;
+    int opt;
+    unsigned int i;
+    FILE *fp;
+
+    while ( (opt = getopt(argc, argv, "v")) != -1 )
+    {
+        switch ( opt )
+        {
+            case 'v':
+                verbose = 1;
+                break;
+
+            default:
+                fprintf(stderr, "usage: %s [-v] tracefile\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if ( optind >= argc )
+    {
+        fprintf(stderr, "usage: %s [-v] tracefile\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if ( (fp = fopen(argv[optind], "rb")) == NULL )
+    {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+
+    if ( fread(&header, sizeof(header), 1, fp) != 1 || header.magic != TRACE_MAGIC ||
+         header.record_size != sizeof(struct trace_record) )
+    {
+        fprintf(stderr, "%s: not a cardamine trace\n", argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+
+    for ( i = 0; i < header.count && fread(&rec, sizeof(rec), 1, fp) == 1; i++ )
+        format_record(&rec, verbose);
+
+    fclose(fp);
+    return 0;
+}
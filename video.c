@@ -2,135 +2,157 @@
 #include "cpu.h"
 #include "mem.h"
 #include "interrupt.h"
+#include "io_regs.h"
 #include "video.h"
+#include "cgb.h"
+#include "sched.h"
 
-unsigned char bg_display;
-unsigned char sprite_display_enable;
-unsigned char sprite_size;
-unsigned char bg_tile_map_display_select;
-unsigned char bg_window_tile_data_select;
-unsigned char window_display_enable;
-unsigned char window_tile_map_display_select;
-unsigned char lcd_display_enable;
-unsigned char lcd_line;
-unsigned char lcd_coincidence_flag;
-unsigned char mode_0_H_Blank_interrupt;
-unsigned char mode_1_V_Blank_interrupt;
-unsigned char mode_2_OAM_interrupt;
-unsigned char LYC_LY_coincidence_interrupt;
-unsigned char lcd_scroll_y;
-unsigned char lcd_scroll_x;
-unsigned char lcd_mode_flag;
-unsigned char lcd_LY_compare;
-unsigned char window_y_pos;
-unsigned char shade_for_color_0;
-unsigned char shade_for_color_1;
-unsigned char shade_for_color_2;
-unsigned char shade_for_color_3;
-unsigned char sprite_0_shade_for_color_0;
-unsigned char sprite_0_shade_for_color_1;
-unsigned char sprite_0_shade_for_color_2;
-unsigned char sprite_1_shade_for_color_0;
-unsigned char sprite_1_shade_for_color_1;
-unsigned char sprite_1_shade_for_color_2;
-unsigned char window_y_position;
-unsigned char window_x_position;
-unsigned int lcd_cycles;
-
-void check_coincidence ( void )
+unsigned int lcd_base;
+
+/* Cycles into the frame at when */
+unsigned int lcd_position ( unsigned int when )
+{
+    return (when - lcd_base) % LCD_FRAME_CYCLES;
+}
+
+unsigned char lcd_mode ( unsigned int position )
+{
+    unsigned int dot = position % LCD_LINE_CYCLES;
+
+    if ( position >= LCD_V_BLANK )
+        return DURING_V_BLANK;
+    if ( dot < LCD_TRANSFER )
+        return DURING_SEARCHING_OAM_RAM;
+    if ( dot < LCD_H_BLANK )
+        return DURING_TRANSFER_DATA_TO_LCD;
+    return DURING_H_BLANK;
+}
+
+unsigned char lcd_LY ( void )
+{
+    unsigned int now = CPU_TIME();
+    unsigned int position = lcd_position(now);
+
+    read_until(now + LCD_LINE_CYCLES - position % LCD_LINE_CYCLES);
+    return position / LCD_LINE_CYCLES;
+}
+
+/* STAT with the mode and coincidence bits filled in */
+unsigned char lcd_STAT ( void )
 {
-    if ( lcd_line == lcd_LY_compare )
+    unsigned int now = CPU_TIME();
+    unsigned int position = lcd_position(now);
+    unsigned int dot = position % LCD_LINE_CYCLES;
+    unsigned char stat = IO_REG(STAT) & ~(STAT_MODE | STAT_COINCIDENCE);
+
+    /* Holds until the next mode change, or the next line */
+    if ( position >= LCD_V_BLANK || dot >= LCD_H_BLANK )
+        read_until(now + LCD_LINE_CYCLES - dot);
+    else if ( dot >= LCD_TRANSFER )
+        read_until(now + LCD_H_BLANK - dot);
+    else
+        read_until(now + LCD_TRANSFER - dot);
+
+    if ( position / LCD_LINE_CYCLES == IO_REG(LYC) )
+        stat |= STAT_COINCIDENCE;
+
+    return stat | lcd_mode(position);
+}
+
+/* The next position after position where the LCD raises an interrupt or
+ * HDMA copies a block, up to a frame ahead */
+unsigned int lcd_next ( unsigned int position )
+{
+    unsigned int line = position / LCD_LINE_CYCLES;
+    unsigned int next = LCD_V_BLANK, at;
+
+    if ( position >= LCD_V_BLANK )
+        next += LCD_FRAME_CYCLES;
+
+    if ( (IO_REG(STAT) & STAT_LYC_INT) && IO_REG(LYC) < LCD_LINES )
     {
-        lcd_coincidence_flag = 1;
-        if ( LYC_LY_coincidence_interrupt )
-            INTERRUPT(LCD_STAT);
+        at = IO_REG(LYC) * LCD_LINE_CYCLES;
+        if ( at <= position )
+            at += LCD_FRAME_CYCLES;
+        if ( at < next )
+            next = at;
     }
-    else
+
+    if ( IO_REG(STAT) & STAT_OAM_INT )
+    {
+        at = (line + 1) * LCD_LINE_CYCLES;
+        if ( at >= LCD_V_BLANK )
+            at = LCD_FRAME_CYCLES;
+        if ( at < next )
+            next = at;
+    }
+
+    if ( (IO_REG(STAT) & STAT_H_BLANK_INT) || hdma_active )
     {
-        lcd_coincidence_flag = 0;
+        at = line * LCD_LINE_CYCLES + LCD_H_BLANK;
+        if ( at <= position )
+            at += LCD_LINE_CYCLES;
+        if ( at >= LCD_V_BLANK )
+            at = LCD_FRAME_CYCLES + LCD_H_BLANK;
+        if ( at < next )
+            next = at;
     }
+
+    return next;
 }
 
-void update_STAT ( void )
+/* Raise whatever is due at this point of the frame, and wait for the next */
+void video_event ( unsigned int when )
 {
-    lcd_cycles += cpu_cycles;
-    switch ( lcd_mode_flag )
+    unsigned int position = lcd_position(when);
+    unsigned int line = position / LCD_LINE_CYCLES;
+    unsigned int dot = position % LCD_LINE_CYCLES;
+
+    if ( position == LCD_V_BLANK )
+    {
+        INTERRUPT(V_BLANK);
+        if ( IO_REG(STAT) & STAT_V_BLANK_INT )
+            INTERRUPT(LCD_STAT);
+        //render_to_screen();
+
+        /* Keep the frame start recent so the cycle counter can wrap */
+        lcd_base = when - LCD_V_BLANK;
+    }
+
+    if ( dot == 0 && line == IO_REG(LYC) && (IO_REG(STAT) & STAT_LYC_INT) )
+        INTERRUPT(LCD_STAT);
+
+    if ( dot == 0 && position < LCD_V_BLANK && (IO_REG(STAT) & STAT_OAM_INT) )
+        INTERRUPT(LCD_STAT);
+
+    if ( dot == LCD_H_BLANK && position < LCD_V_BLANK )
     {
-        case DURING_H_BLANK:
-            if ( lcd_cycles >= 204 )
-            {
-                lcd_line++;
-                check_coincidence();
-                if ( lcd_line == 144 )
-                {
-                    lcd_mode_flag = DURING_V_BLANK;
-                    //render_to_screen();
-                    if ( mode_1_V_Blank_interrupt )
-                        INTERRUPT(LCD_STAT);
-                    INTERRUPT(V_BLANK);
-                    /* XXX: Handle RTC counter */
-                }
-                else
-                {
-                    lcd_mode_flag = DURING_SEARCHING_OAM_RAM;
-                    if ( mode_2_OAM_interrupt )
-                        INTERRUPT(LCD_STAT);
-                }
-                lcd_cycles -= 204;
-            }
-            break;
-
-        case DURING_V_BLANK:
-            if ( lcd_cycles >= 456 )
-            {
-                lcd_line++;
-                check_coincidence();
-                if ( lcd_line == 154 )
-                {
-                    lcd_line = 0;
-                }
-                else if ( lcd_line == 1 )
-                {
-                    lcd_line = 0;
-                    lcd_mode_flag = DURING_SEARCHING_OAM_RAM;
-                    check_coincidence();
-                    if ( mode_2_OAM_interrupt )
-                        INTERRUPT(LCD_STAT);
-                }
-
-                lcd_cycles -= 456;
-            }
-            break;
-
-        case DURING_SEARCHING_OAM_RAM:
-            if ( lcd_cycles >= 80 )
-            {
-                lcd_mode_flag = DURING_TRANSFER_DATA_TO_LCD;
-                lcd_cycles -= 80;
-            }
-            break;
-
-        case DURING_TRANSFER_DATA_TO_LCD:
-            if ( lcd_cycles >= 172 )
-            {
-            //    scanline();
-                lcd_mode_flag = DURING_H_BLANK;
-                if ( mode_0_H_Blank_interrupt )
-                    INTERRUPT(LCD_STAT);
-                lcd_cycles -= 172;
-            }
-            break;
+        //    scanline();
+        if ( IO_REG(STAT) & STAT_H_BLANK_INT )
+            INTERRUPT(LCD_STAT);
+        if ( hdma_active )
+            hdma_hblank();
     }
+
+    schedule(EVENT_VIDEO, when + lcd_next(position) - position);
 }
 
-void init_video ( void )
+/* Called when STAT, LYC or the HBlank DMA changes what the next event is */
+void restart_video ( void )
 {
-    lcd_cycles = 0;
+    unsigned int position = lcd_position(CPU_TIME());
+
+    schedule(EVENT_VIDEO, CPU_TIME() + lcd_next(position) - position);
 }
 
-// Timing stolen from zid's gameboy-emulator until
-// a better timing subsystem is determined
-void cycle_video ( void )
+/* Writing LY restarts the frame */
+void reset_LY ( void )
+{
+    lcd_base = CPU_TIME();
+    restart_video();
+}
+
+void init_video ( void )
 {
-    update_STAT();
+    reset_LY();
 }
@@ -1,40 +1,28 @@
 void init_video(void);
-void check_coincidence(void);
-void update_STAT(void);
-void cycle_video(void);
+unsigned char lcd_LY(void);
+unsigned char lcd_STAT(void);
+void video_event(unsigned int when);
+void restart_video(void);
+void reset_LY(void);
 
-unsigned char bg_display;
-unsigned char sprite_display_enable;
-unsigned char sprite_size;
-unsigned char bg_tile_map_display_select;
-unsigned char bg_window_tile_data_select;
-unsigned char window_display_enable;
-unsigned char window_tile_map_display_select;
-unsigned char lcd_display_enable;
-unsigned char lcd_line;
-unsigned char lcd_coincidence_flag;
-unsigned char mode_0_H_Blank_interrupt;
-unsigned char mode_1_V_Blank_interrupt;
-unsigned char mode_2_OAM_interrupt;
-unsigned char LYC_LY_coincidence_interrupt;
-unsigned char lcd_scroll_y;
-unsigned char lcd_scroll_x;
-unsigned char lcd_mode_flag;
-unsigned char lcd_LY_compare;
-unsigned char window_y_pos;
-unsigned char shade_for_color_0;
-unsigned char shade_for_color_1;
-unsigned char shade_for_color_2;
-unsigned char shade_for_color_3;
-unsigned char sprite_0_shade_for_color_0;
-unsigned char sprite_0_shade_for_color_1;
-unsigned char sprite_0_shade_for_color_2;
-unsigned char sprite_1_shade_for_color_0;
-unsigned char sprite_1_shade_for_color_1;
-unsigned char sprite_1_shade_for_color_2;
-unsigned char window_y_position;
-unsigned char window_x_position;
-unsigned int lcd_cycles;
+/*
+ * The LCD is not stepped through its modes: LY, the STAT mode bits and the
+ * coincidence flag are worked out from the cycles since the frame began,
+ * lcd_base, when they are read.  EVENT_VIDEO is only due where something
+ * happens: VBlank, each enabled STAT interrupt source, and the HBlanks an
+ * HBlank DMA copies in.
+ */
+unsigned int lcd_base;
+
+#define LCD_LINE_CYCLES  456
+#define LCD_LINES        154
+#define LCD_FRAME_CYCLES (LCD_LINE_CYCLES * LCD_LINES)
+
+/* Offsets into a visible line where each mode begins, and into the frame
+ * where VBlank does */
+#define LCD_TRANSFER 80
+#define LCD_H_BLANK  252
+#define LCD_V_BLANK  (144 * LCD_LINE_CYCLES)
 
 #define DURING_H_BLANK              0
 #define DURING_V_BLANK              1
@@ -0,0 +1,83 @@
+#include "common.h"
+#include "cpu.h"
+#include "mem.h"
+#include "jit.h"
+#include "block.h"
+#include "watch.h"
+
+watch_handler watch_hook;
+break_handler break_hook;
+unsigned char watch_flags[0x10000];
+unsigned short watch_pages[0x100];
+unsigned short break_pages[0x100];
+
+void add_watchpoint ( unsigned short addr, unsigned char kind )
+{
+    if ( !(watch_flags[addr] & (WATCH_READ | WATCH_WRITE)) )
+        watch_pages[addr >> 8]++;
+
+    watch_flags[addr] |= kind & (WATCH_READ | WATCH_WRITE);
+    map_page(addr >> 8);
+}
+
+void remove_watchpoint ( unsigned short addr )
+{
+    if ( !(watch_flags[addr] & (WATCH_READ | WATCH_WRITE)) )
+        return;
+
+    watch_flags[addr] &= ~(WATCH_READ | WATCH_WRITE);
+    watch_pages[addr >> 8]--;
+    map_page(addr >> 8);
+}
+
+/* Cached code may run through the page, or have left it to the interpreter,
+ * so start over either way */
+void add_breakpoint ( unsigned short addr )
+{
+    if ( watch_flags[addr] & BREAKPOINT )
+        return;
+
+    watch_flags[addr] |= BREAKPOINT;
+    break_pages[addr >> 8]++;
+    jit_flush();
+    block_flush();
+}
+
+void remove_breakpoint ( unsigned short addr )
+{
+    if ( !(watch_flags[addr] & BREAKPOINT) )
+        return;
+
+    watch_flags[addr] &= ~BREAKPOINT;
+    break_pages[addr >> 8]--;
+    jit_flush();
+    block_flush();
+}
+
+/* Slow-path read from a watched page */
+char watch_read ( unsigned short addr )
+{
+    char *page = mem_page[addr >> 8];
+    char value = page ? page[addr & 0xff] : 0xff;
+
+    if ( (watch_flags[addr] & WATCH_READ) && watch_hook )
+        watch_hook(pc, addr, value, value);
+
+    return value;
+}
+
+/* Slow-path write to a watched address, before it is stored */
+void watch_write ( unsigned short addr, char value )
+{
+    char *page = mem_page[addr >> 8];
+
+    if ( watch_hook )
+        watch_hook(pc, addr, page ? page[addr & 0xff] : 0xff, value);
+}
+
+/* Called before interpreting an instruction on a page with breakpoints */
+void check_breakpoint ( void )
+{
+    if ( (watch_flags[pc] & BREAKPOINT) && break_hook )
+        break_hook(pc);
+}
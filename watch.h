@@ -0,0 +1,33 @@
+void add_watchpoint(unsigned short addr, unsigned char kind);
+void remove_watchpoint(unsigned short addr);
+void add_breakpoint(unsigned short addr);
+void remove_breakpoint(unsigned short addr);
+char watch_read(unsigned short addr);
+void watch_write(unsigned short addr, char value);
+void check_breakpoint(void);
+
+/*
+ * Watchpoints and breakpoints.  A page with a watchpoint on it is mapped
+ * out of the page table, so only accesses to that page reach the slow path
+ * and check the address.  Code is never cached from a page with a
+ * breakpoint on it, so pc is only checked while it is being interpreted.
+ * Pages without either run exactly as before.
+ */
+
+#define WATCH_READ  0x1
+#define WATCH_WRITE 0x2
+#define BREAKPOINT  0x4
+
+/* Called with pc already past the accessing instruction; old and value are
+ * the same for reads */
+typedef void (*watch_handler)(unsigned short pc, unsigned short addr, unsigned char old, unsigned char value);
+typedef void (*break_handler)(unsigned short pc);
+
+watch_handler watch_hook;
+break_handler break_hook;
+
+unsigned char watch_flags[0x10000];
+
+/* Watchpoints and breakpoints set on each page */
+unsigned short watch_pages[0x100];
+unsigned short break_pages[0x100];